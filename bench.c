@@ -0,0 +1,148 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FIB_DEV "/dev/fibonacci"
+#define FIB_PARAMS "/sys/module/fibdrv_new/parameters/"
+#define OFFSET 1000
+#define ITERATIONS 2000
+
+/*
+ * Multi-threaded stress benchmark for /dev/fibonacci.
+ *
+ * Every thread opens its own file and keeps reading F(offset), so the
+ * reported throughput shows how the driver scales with the number of
+ * concurrent readers. The average in-kernel compute time and number of
+ * heap allocations per read are taken from the timing interface of
+ * fib_write. Only the first read of each file computes F(offset) unless
+ * the module is loaded with use_cursor=0 cache_size=0 checkpoint_gap=0,
+ * the rest are served by the cursor, cache or a checkpoint.
+ *
+ * usage: bench [offset] [iterations] [max threads]
+ */
+
+struct worker {
+    pthread_t tid;
+    long long offset;
+    int iterations;
+    int failed;
+    long long kernel_ns;
+    long long allocs;
+};
+
+static void *worker_fn(void *arg)
+{
+    struct worker *w = arg;
+    /* F(k) has about 0.695k bits */
+    size_t size = (w->offset / 64 + 2) * sizeof(unsigned long long);
+    unsigned long long *buf = malloc(size);
+    char write_buf[] = "timing";
+
+    int fd = open(FIB_DEV, O_RDWR);
+    if (fd < 0 || !buf) {
+        w->failed = 1;
+        free(buf);
+        return NULL;
+    }
+    for (int i = 0; i < w->iterations; i++) {
+        lseek(fd, w->offset, SEEK_SET);
+        if (read(fd, buf, size) <= 0) {
+            w->failed = 1;
+            break;
+        }
+        lseek(fd, 0, SEEK_SET);
+        w->kernel_ns += write(fd, write_buf, strlen(write_buf));
+        lseek(fd, 2, SEEK_SET);
+        w->allocs += write(fd, write_buf, strlen(write_buf));
+    }
+    close(fd);
+    free(buf);
+    return NULL;
+}
+
+/* Whether module parameter name is set to anything but 0 or N */
+static int param_on(const char *name)
+{
+    char path[128], val[16] = "";
+    FILE *f;
+
+    snprintf(path, sizeof(path), FIB_PARAMS "%s", name);
+    f = fopen(path, "r");
+    if (!f)
+        return 0;
+    if (!fgets(val, sizeof(val), f))
+        val[0] = '0';
+    fclose(f);
+    return val[0] != '0' && val[0] != 'N';
+}
+
+static double run(int nthreads,
+                  long long offset,
+                  int iterations,
+                  double *kernel_us,
+                  double *allocs)
+{
+    struct worker *workers = calloc(nthreads, sizeof(*workers));
+    struct timespec tp_start, tp_end;
+
+    if (!workers)
+        return -1;
+    clock_gettime(CLOCK_MONOTONIC, &tp_start);
+    for (int i = 0; i < nthreads; i++) {
+        workers[i].offset = offset;
+        workers[i].iterations = iterations;
+        pthread_create(&workers[i].tid, NULL, worker_fn, &workers[i]);
+    }
+    int failed = 0;
+    long long kernel_ns = 0, nallocs = 0;
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(workers[i].tid, NULL);
+        failed |= workers[i].failed;
+        kernel_ns += workers[i].kernel_ns;
+        nallocs += workers[i].allocs;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &tp_end);
+    free(workers);
+    if (failed)
+        return -1;
+    *kernel_us = kernel_ns / 1e3 / ((double) nthreads * iterations);
+    *allocs = nallocs / ((double) nthreads * iterations);
+
+    double sec = (tp_end.tv_sec - tp_start.tv_sec) +
+                 (tp_end.tv_nsec - tp_start.tv_nsec) / 1e9;
+    return (double) nthreads * iterations / sec;
+}
+
+int main(int argc, char *argv[])
+{
+    long long offset = argc > 1 ? atoll(argv[1]) : OFFSET;
+    int iterations = argc > 2 ? atoi(argv[2]) : ITERATIONS;
+    int max_threads =
+        argc > 3 ? atoi(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+
+    printf("# offset %lld, %d reads per thread\n", offset, iterations);
+    if (param_on("use_cursor") || param_on("cache_size") ||
+        (offset >= 4096 && param_on("checkpoint_gap")))
+        printf("# repeated reads skip the computation, load with "
+               "use_cursor=0 cache_size=0 checkpoint_gap=0 to time it\n");
+    printf("# threads reads/s speedup kernel-us/read allocs/read\n");
+    double base = 0;
+    for (int n = 1; n <= max_threads; n++) {
+        double kernel_us, allocs;
+        double tput = run(n, offset, iterations, &kernel_us, &allocs);
+        if (tput < 0) {
+            perror("Failed to read from " FIB_DEV);
+            exit(1);
+        }
+        if (n == 1)
+            base = tput;
+        printf("%d %.0f %.2f %.1f %.1f\n", n, tput, tput / base, kernel_us,
+               allocs);
+    }
+    return 0;
+}
@@ -1,61 +1,271 @@
 #include "bn.h"
+#include <linux/cpumask.h>
+#include <linux/debugfs.h>
+#include <linux/jump_label.h>
+#include <linux/ktime.h>
+#include <linux/limits.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
 #include <linux/minmax.h>
+#include <linux/mm.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#ifdef CONFIG_X86_64
+#include <asm/cpufeature.h>
+#endif
+
+/* Scratch needed by bn_mul_limbs when the larger operand has n limbs */
+#define BN_MUL_SCRATCH(n) (6 * (n) + 128)
+
+/* Heap blocks up to this many limbs are rounded up to a power of two */
+#define BN_HEAP_ROUND 512
+
+static unsigned long long bn_ntt_scratch(unsigned long long len, bool par);
+static bool bn_parallel(unsigned long long n);
+
+static bool bn_in_pool(const struct bn_arena *arena,
+                       const unsigned long long *ptr)
+{
+    return arena && ptr >= arena->pool &&
+           ptr < arena->pool + arena->nblocks * arena->block_len;
+}
+
+/*
+ * Limbs actually allocated for a heap value of length limbs: the next
+ * power of two for small values, which kmalloc would round to anyway, and
+ * above that a multiple of a quarter of the top power of two, so regrowing
+ * copies once per 25%.
+ */
+static unsigned long long bn_heap_len(unsigned long long length)
+{
+    if (length <= BN_HEAP_ROUND)
+        return roundup_pow_of_two(length);
+    unsigned long long step = 1ULL << (61 - __builtin_clzll(length));
+    return (length + step - 1) & ~(step - 1);
+}
+
+/*
+ * kvmalloc, so large values need no physically contiguous memory, except
+ * above INT_MAX bytes, which kvmalloc refuses
+ */
+static void *bn_kvmalloc(size_t size)
+{
+    return size > INT_MAX ? vmalloc(size) : kvmalloc(size, GFP_KERNEL);
+}
+
+static unsigned long long *bn_heap_alloc(struct bn_arena *arena,
+                                         unsigned long long length)
+{
+    if (!arena)
+        return bn_kvmalloc(sizeof(unsigned long long) * bn_heap_len(length));
+    ktime_t kt = ktime_get();
+    unsigned long long *ptr =
+        bn_kvmalloc(sizeof(unsigned long long) * bn_heap_len(length));
+    arena->heap_ns += ktime_to_ns(ktime_sub(ktime_get(), kt));
+    arena->heap_allocs++;
+    return ptr;
+}
+
+/* Storage for at least length limbs, cap is set to how many it holds */
+static unsigned long long *bn_alloc(struct bn_arena *arena,
+                                    unsigned long long length,
+                                    unsigned long long *cap)
+{
+    if (arena && length <= arena->block_len && arena->free_map) {
+        int i = __builtin_ctzll(arena->free_map);
+        arena->free_map &= ~(1ULL << i);
+        *cap = arena->block_len;
+        return arena->pool + i * arena->block_len;
+    }
+    *cap = bn_heap_len(length);
+    return bn_heap_alloc(arena, length);
+}
+
+static void bn_dealloc(struct bn_arena *arena, unsigned long long *ptr)
+{
+    if (bn_in_pool(arena, ptr))
+        arena->free_map |= 1ULL << ((ptr - arena->pool) / arena->block_len);
+    else
+        kvfree(ptr);
+}
+
+static unsigned long long *bn_scratch_get(struct bn_arena *arena,
+                                          unsigned long long length)
+{
+    if (arena && !arena->scratch_busy && length <= arena->scratch_len) {
+        arena->scratch_busy = true;
+        return arena->scratch;
+    }
+    return bn_heap_alloc(arena, length);
+}
+
+static void bn_scratch_put(struct bn_arena *arena, unsigned long long *ptr)
+{
+    if (arena && ptr == arena->scratch)
+        arena->scratch_busy = false;
+    else
+        kvfree(ptr);
+}
+
+/*
+ * Scratch for multiplications whose product fits block_len limbs, with the
+ * NTT spread over CPUs if par
+ */
+static unsigned long long bn_arena_scratch(unsigned long long block_len,
+                                           bool par)
+{
+    unsigned long long len = BN_MUL_SCRATCH(block_len);
+
+    if (block_len / 2 >= bn_ntt_threshold)
+        len = max(len, bn_ntt_scratch(block_len, par));
+    return len;
+}
+
+/*
+ * The most scratch one product whose result fits block_len limbs may take,
+ * whatever the thresholds are set to
+ */
+unsigned long long bn_scratch_max(unsigned long long block_len)
+{
+    return max(BN_MUL_SCRATCH(block_len), bn_ntt_scratch(block_len, true));
+}
+
+/*
+ * Make arena hold nblocks values of up to block_len limbs each, plus
+ * scratch for multiplications whose product fits a block, and mark all of
+ * it free. Memory is only reallocated when the current pool is too small.
+ * On failure the arena is left empty, so all allocations go to the heap.
+ */
+bool bn_arena_reserve(struct bn_arena *arena,
+                      unsigned long long block_len,
+                      unsigned long long nblocks)
+{
+    nblocks = min(nblocks, (unsigned long long) BN_ARENA_MAX_BLOCKS);
+    if (arena->block_len < block_len || arena->nblocks < nblocks) {
+        unsigned long long scratch_len =
+            bn_arena_scratch(block_len, bn_parallel(block_len / 2));
+        bn_arena_release(arena);
+        ktime_t kt = ktime_get();
+        arena->pool = bn_kvmalloc(sizeof(unsigned long long) *
+                                  (nblocks * block_len + scratch_len));
+        arena->heap_ns += ktime_to_ns(ktime_sub(ktime_get(), kt));
+        arena->heap_allocs++;
+        if (!arena->pool)
+            return false;
+        arena->block_len = block_len;
+        arena->nblocks = nblocks;
+        arena->scratch = arena->pool + nblocks * block_len;
+        arena->scratch_len = scratch_len;
+    }
+    arena->free_map = arena->nblocks == BN_ARENA_MAX_BLOCKS
+                          ? ~0ULL
+                          : (1ULL << arena->nblocks) - 1;
+    arena->scratch_busy = false;
+    return true;
+}
+
+void bn_arena_release(struct bn_arena *arena)
+{
+    kvfree(arena->pool);
+    arena->pool = arena->scratch = NULL;
+    arena->block_len = arena->nblocks = arena->scratch_len = 0;
+    arena->free_map = 0;
+    arena->scratch_busy = false;
+}
+
+/*
+ * Sets the length to length limbs, of which the first keep keep their
+ * value and the rest are undefined. Storage only changes once the value
+ * outgrows its capacity: the inline limbs, its pool block or its rounded
+ * up heap block, so shrinking and regrowing costs nothing.
+ */
+static bool bn_resize(bn_t *bn_ptr,
+                      unsigned long long length,
+                      unsigned long long keep)
+{
+    if (!bn_ptr->num) {
+        bn_ptr->length = 0;
+        bn_ptr->cap = 0;
+        if (length <= BN_INLINE_LIMBS) {
+            bn_ptr->num = bn_ptr->inl;
+            bn_ptr->cap = BN_INLINE_LIMBS;
+        }
+    }
+    if (length > bn_ptr->cap) {
+        unsigned long long cap;
+        unsigned long long *ptr = bn_alloc(bn_ptr->arena, length, &cap);
+        if (!ptr)
+            return false;
+        if (bn_ptr->num) {
+            memcpy(ptr, bn_ptr->num,
+                   sizeof(unsigned long long) * min(keep, bn_ptr->length));
+            if (bn_ptr->num != bn_ptr->inl)
+                bn_dealloc(bn_ptr->arena, bn_ptr->num);
+        }
+        bn_ptr->num = ptr;
+        bn_ptr->cap = cap;
+    }
+    bn_ptr->length = length;
+    return true;
+}
+
 // cppcheck-suppress unusedFunction
 bool bn_new(bn_t *bn_ptr, unsigned long long length)
 {
-    bn_ptr->length = 0;
-    if ((bn_ptr->num =
-             kmalloc(sizeof(unsigned long long) * length, GFP_KERNEL)))
-        bn_ptr->length = length;
-    return !!bn_ptr->num;
+    bn_ptr->num = NULL;
+    return bn_resize(bn_ptr, length, 0);
 }
 
 bool bn_znew(bn_t *bn_ptr, unsigned long long length)
 {
-    bn_ptr->length = 0;
-    if ((bn_ptr->num =
-             kzalloc(sizeof(unsigned long long) * length, GFP_KERNEL)))
-        bn_ptr->length = length;
-    return !!bn_ptr->num;
+    if (!bn_new(bn_ptr, length))
+        return false;
+    memset(bn_ptr->num, 0, sizeof(unsigned long long) * length);
+    return true;
 }
 
 bool bn_zrenew(bn_t *bn_ptr, unsigned long long length)
 {
-    if (length == bn_ptr->length) {
-        memset(bn_ptr->num, 0, sizeof(unsigned long long) * length);
-        return true;
-    }
-    unsigned long long *tmp =
-        krealloc(bn_ptr->num, sizeof(unsigned long long) * length, GFP_KERNEL);
-    if (tmp == NULL)
+    if (!bn_resize(bn_ptr, length, 0))
         return false;
-    memset(tmp, 0, sizeof(unsigned long long) * length);
-    bn_ptr->length = length;
-    bn_ptr->num = tmp;
+    memset(bn_ptr->num, 0, sizeof(unsigned long long) * length);
     return true;
 }
 
 bool bn_extend(bn_t *bn_ptr, unsigned long long length)
 {
     unsigned long long origin = bn_ptr->length;
-    if (length < origin)
-        return true;
-    if (length == bn_ptr->length)
+    if (length <= origin)
         return true;
-    unsigned long long *tmp =
-        krealloc(bn_ptr->num, sizeof(unsigned long long) * length, GFP_KERNEL);
-    if (tmp == NULL)
+    if (!bn_resize(bn_ptr, length, origin))
         return false;
-    memset(tmp + origin, 0, sizeof(unsigned long long) * (length - origin));
-    bn_ptr->length = length;
-    bn_ptr->num = tmp;
+    memset(bn_ptr->num + origin, 0,
+           sizeof(unsigned long long) * (length - origin));
+    return true;
+}
+
+/* Like bn_zrenew, but leaves the limbs for the caller to fill */
+bool bn_renew(bn_t *bn_ptr, unsigned long long length)
+{
+    return bn_resize(bn_ptr, length, 0);
+}
+
+/* dst = src, in a single pass */
+bool bn_copy(bn_t *dst, const bn_t *src)
+{
+    if (!bn_resize(dst, src->length, 0))
+        return false;
+    memcpy(dst->num, src->num, sizeof(unsigned long long) * src->length);
     return true;
 }
 
 bool bn_shrink(bn_t *bn_ptr)
 {
-    int i;
+    long long i;
     for (i = bn_ptr->length - 1; i >= 0; i--) {
         if (bn_ptr->num[i] > 0)
             break;
@@ -69,10 +279,166 @@ bool bn_shrink(bn_t *bn_ptr)
 // cppcheck-suppress unusedFunction
 void bn_free(bn_t *bn_ptr)
 {
-    kfree(bn_ptr->num);
+    if (bn_ptr->num != bn_ptr->inl)
+        bn_dealloc(bn_ptr->arena, bn_ptr->num);
     bn_ptr->num = NULL;
-    bn_ptr->length = 0;
+    bn_ptr->length = bn_ptr->cap = 0;
+}
+/*
+ * Add and subtract kernels on limb arrays (least significant limb first).
+ * The loops in C are the portable version; x86-64 always has the adc and
+ * sbb carry chain, so there the kernels below run the limbs through it.
+ */
+
+/* r = a + b + carry, returns the carry out */
+static unsigned long long bn_add_nc_generic(unsigned long long *r,
+                                            const unsigned long long *a,
+                                            const unsigned long long *b,
+                                            unsigned long long n,
+                                            unsigned long long carry)
+{
+    for (unsigned long long i = 0; i < n; i++) {
+        unsigned long long s = a[i] + carry;
+        carry = s < carry;
+        r[i] = s + b[i];
+        carry += r[i] < s;
+    }
+    return carry;
+}
+
+/* r = a - b - borrow, returns the borrow out */
+static unsigned long long bn_sub_nc_generic(unsigned long long *r,
+                                            const unsigned long long *a,
+                                            const unsigned long long *b,
+                                            unsigned long long n,
+                                            unsigned long long borrow)
+{
+    for (unsigned long long i = 0; i < n; i++) {
+        unsigned long long d = a[i] - borrow;
+        borrow = d > a[i];
+        r[i] = d - b[i];
+        borrow += r[i] > d;
+    }
+    return borrow;
+}
+
+#ifdef CONFIG_X86_64
+/*
+ * Four limbs per iteration with the carry in CF all along: dec counts the
+ * iterations without touching it. The n % 4 limbs in front go through the
+ * generic loop. r may be a or b, each limb is loaded before it is stored.
+ */
+#define BN_ADC_4(op)                             \
+    "mov (%[a],%[i],8), %[t]\n\t"                \
+    op " (%[b],%[i],8), %[t]\n\t"                \
+    "mov %[t], (%[r],%[i],8)\n\t"                \
+    "mov 8(%[a],%[i],8), %[t]\n\t"               \
+    op " 8(%[b],%[i],8), %[t]\n\t"               \
+    "mov %[t], 8(%[r],%[i],8)\n\t"               \
+    "mov 16(%[a],%[i],8), %[t]\n\t"              \
+    op " 16(%[b],%[i],8), %[t]\n\t"              \
+    "mov %[t], 16(%[r],%[i],8)\n\t"              \
+    "mov 24(%[a],%[i],8), %[t]\n\t"              \
+    op " 24(%[b],%[i],8), %[t]\n\t"              \
+    "mov %[t], 24(%[r],%[i],8)\n\t"
+
+/* Runs BN_ADC_4 over the q blocks from limb i of r, a and b */
+#define BN_ADC_LOOP(op, carry)                                      \
+    asm volatile("neg %[c]\n\t"                                     \
+                 "1:\n\t" BN_ADC_4(op) "lea 4(%[i]), %[i]\n\t"      \
+                 "dec %[q]\n\t"                                     \
+                 "jnz 1b\n\t"                                       \
+                 "mov $0, %k[c]\n\t"                                \
+                 "setc %b[c]"                                       \
+                 : [c] "+&r"(carry), [i] "+&r"(i), [q] "+&r"(q),    \
+                   [t] "=&r"(t)                                     \
+                 : [r] "r"(r), [a] "r"(a), [b] "r"(b)               \
+                 : "cc", "memory")
+
+static unsigned long long bn_add_nc_x86(unsigned long long *r,
+                                        const unsigned long long *a,
+                                        const unsigned long long *b,
+                                        unsigned long long n,
+                                        unsigned long long carry)
+{
+    unsigned long long i = n % 4, q = n / 4, t;
+
+    carry = bn_add_nc_generic(r, a, b, i, carry);
+    if (q)
+        BN_ADC_LOOP("adc", carry);
+    return carry;
+}
+
+static unsigned long long bn_sub_nc_x86(unsigned long long *r,
+                                        const unsigned long long *a,
+                                        const unsigned long long *b,
+                                        unsigned long long n,
+                                        unsigned long long borrow)
+{
+    unsigned long long i = n % 4, q = n / 4, t;
+
+    borrow = bn_sub_nc_generic(r, a, b, i, borrow);
+    if (q)
+        BN_ADC_LOOP("sbb", borrow);
+    return borrow;
+}
+
+#define bn_add_nc bn_add_nc_x86
+#define bn_sub_nc bn_sub_nc_x86
+#else
+#define bn_add_nc bn_add_nc_generic
+#define bn_sub_nc bn_sub_nc_generic
+#endif
+
+/* r = a + b, returns the carry out */
+static inline unsigned long long bn_add_n(unsigned long long *r,
+                                          const unsigned long long *a,
+                                          const unsigned long long *b,
+                                          unsigned long long n)
+{
+    return bn_add_nc(r, a, b, n, 0);
+}
+
+/* r = a - b, returns the borrow out */
+static inline unsigned long long bn_sub_n(unsigned long long *r,
+                                          const unsigned long long *a,
+                                          const unsigned long long *b,
+                                          unsigned long long n)
+{
+    return bn_sub_nc(r, a, b, n, 0);
+}
+
+/* r = a + b where an >= bn, returns the carry out */
+static unsigned long long bn_add_limbs(unsigned long long *r,
+                                       const unsigned long long *a,
+                                       unsigned long long an,
+                                       const unsigned long long *b,
+                                       unsigned long long bn)
+{
+    unsigned long long carry = bn_add_n(r, a, b, bn);
+    for (unsigned long long i = bn; i < an; i++) {
+        r[i] = a[i] + carry;
+        carry = r[i] < carry;
+    }
+    return carry;
 }
+
+/* r = a - b where an >= bn, returns the borrow out */
+static unsigned long long bn_sub_limbs(unsigned long long *r,
+                                       const unsigned long long *a,
+                                       unsigned long long an,
+                                       const unsigned long long *b,
+                                       unsigned long long bn)
+{
+    unsigned long long borrow = bn_sub_n(r, a, b, bn);
+    for (unsigned long long i = bn; i < an; i++) {
+        unsigned long long d = a[i] - borrow;
+        borrow = d > a[i];
+        r[i] = d;
+    }
+    return borrow;
+}
+
 // cppcheck-suppress unusedFunction
 bool bn_add(const bn_t *a, const bn_t *b, bn_t *res)
 {
@@ -80,12 +446,14 @@ bool bn_add(const bn_t *a, const bn_t *b, bn_t *res)
         (a->length == b->length &&
          b->num[b->length - 1] > a->num[a->length - 1]))
         swap(a, b);
-    if (!bn_zrenew(res, a->length + ((a->num[a->length - 1] &
-                                      1LLU << (sizeof(unsigned long long) * 8 -
-                                               1)) > 0)))
+    /* a carry out of the top limb needs its most significant bit set */
+    unsigned long long length = a->length + (a->num[a->length - 1] >> 63);
+    if (!bn_resize(res, length, 0))
         return false;
-    bn_move(a, res);
-    bn_add_carry(b, res, 0);
+    unsigned long long carry =
+        bn_add_limbs(res->num, a->num, a->length, b->num, b->length);
+    if (length > a->length)
+        res->num[a->length] = carry;
     return true;
 }
 
@@ -94,17 +462,13 @@ bool bn_add(const bn_t *a, const bn_t *b, bn_t *res)
 // cppcheck-suppress unusedFunction
 bool bn_sub(const bn_t *a, const bn_t *b, bn_t *res)
 {
-    if (!bn_zrenew(res, max(a->length, b->length)))
+    if (!bn_resize(res, max(a->length, b->length), 0))
         return false;
-
-    if (a->length > b->length) {
-        bn_toggle_move(a, res);
-        bn_add_carry(b, res, 0);   // res = (~a+b) = b-a-1
-        bn_toggle_move(res, res);  // res = ~(b-a-1) = (a-b+1) -1 = a-b
-    } else {
-        bn_toggle_move(b, res);
-        bn_add_carry(a, res, 1);
-    }
+    /* b's limbs above a's are zero */
+    bn_sub_limbs(res->num, a->num, a->length, b->num,
+                 min(a->length, b->length));
+    memset(res->num + a->length, 0,
+           sizeof(unsigned long long) * (res->length - a->length));
     return true;
 }
 
@@ -112,7 +476,7 @@ bool bn_toggle_move(const bn_t *a, bn_t *res)
 {
     if (a->length > res->length)
         return false;
-    int i;
+    unsigned long long i;
     for (i = 0; i < a->length; i++)
         res->num[i] = ~a->num[i];
     for (; i < res->length; i++)
@@ -124,7 +488,7 @@ bool bn_move(const bn_t *a, bn_t *res)
 {
     if (a->length > res->length)
         return false;
-    int i;
+    unsigned long long i;
     for (i = 0; i < a->length; i++)
         res->num[i] = a->num[i];
     for (; i < res->length; i++)
@@ -134,59 +498,57 @@ bool bn_move(const bn_t *a, bn_t *res)
 
 void bn_add_carry(const bn_t *b, bn_t *res, int carry)
 {
-    int i;
-    /*
-     * Use bit operation to check overflow.
-     * There are four cases which overflow:
-     *
-     * msb b        : 0 1 1 1
-     * msb res      : 1 0 1 1
-     * msb b + res  : 0 0 0 1
-     *
-     * If overflow occur, it means the carry will
-     * be one on next loop.
-     */
-    for (i = 0; i < b->length; i++) {
-        unsigned long long overflow = b->num[i] & res->num[i];
-        unsigned long long msb = b->num[i] | res->num[i];
-        res->num[i] += b->num[i] + carry;
-        msb &= ~res->num[i];
-        overflow |= msb;
-        carry = !!(overflow & 1ULL << 63);
+    carry = bn_add_nc(res->num, res->num, b->num, b->length, carry);
+    for (unsigned long long i = b->length; i < res->length && carry; i++)
+        carry = !++res->num[i];
+}
+
+bool bn_add_u64(bn_t *res, unsigned long long v)
+{
+    for (unsigned long long i = 0; i < res->length && v; i++) {
+        res->num[i] += v;
+        v = res->num[i] < v;
     }
-    for (; i < res->length && carry; i++) {
-        unsigned long long msb = res->num[i];
-        res->num[i] += carry;
-        msb &= ~res->num[i];
-        carry = !!(msb & 1ULL << 63);
+    if (!v)
+        return true;
+    if (!bn_extend(res, res->length + 1))
+        return false;
+    res->num[res->length - 1] = v;
+    return true;
+}
+
+// The caller must make sure that res >= v.
+void bn_sub_u64(bn_t *res, unsigned long long v)
+{
+    for (unsigned long long i = 0; i < res->length && v; i++) {
+        unsigned long long d = res->num[i] - v;
+        v = d > res->num[i];
+        res->num[i] = d;
     }
 }
 
 bool bn_lshift(bn_t *res, unsigned long long bits)
 {
-    if (!bits)
+    if (!bits || !res->length)
         return true;
-    // unsigned long long origin = res->length;
-    unsigned long long shift_len = (bits >> 3) / sizeof(shift_len) + 1;
-    unsigned long long mod_bits = bits & 0x3fULL;
-    bool remained = true;
-
-    if (shift_len > res->length)
-        remained = false;
-    else
-        for (int i = res->length - shift_len; i < res->length; i++)
-            if (res->num[i] > 0)
-                remained = false;
-
-    if (!remained && !bn_extend(res, shift_len + res->length))
+    unsigned long long limbs = bits / 64, mod_bits = bits % 64;
+    unsigned long long n = res->length;
+    while (n > 1 && !res->num[n - 1])
+        n--;
+    /* one limb more only if the top limb's bits are pushed out of it */
+    unsigned long long length =
+        n + limbs + (mod_bits && res->num[n - 1] >> (64 - mod_bits));
+    if (length > res->length && !bn_resize(res, length, n))
         return false;
 
-    for (int i = res->length - 1; i >= shift_len; i--)
-        res->num[i] = (res->num[i - shift_len + 1] << mod_bits) |
-                      ((res->num[i - shift_len] >> (63 - mod_bits)) >> 1);
-    res->num[shift_len - 1] = res->num[0] << mod_bits;
-    for (int i = 0; i < shift_len - 1; i++)
-        res->num[i] = 0;
+    /* top down, so every limb is read before it is overwritten */
+    unsigned long long *num = res->num;
+    for (unsigned long long i = length; i-- > limbs;) {
+        unsigned long long j = i - limbs;
+        unsigned long long hi = j < n ? num[j] : 0, lo = j ? num[j - 1] : 0;
+        num[i] = mod_bits ? hi << mod_bits | lo >> (64 - mod_bits) : hi;
+    }
+    memset(num, 0, sizeof(unsigned long long) * limbs);
     return true;
 }
 
@@ -197,12 +559,12 @@ void bn_rshift(bn_t *res, unsigned long long bits)
     unsigned long long shift_len = bits / 64;
     unsigned long long mod_bits = bits & 0x3fULL;
 
-    if (shift_len > res->length) {
+    if (shift_len >= res->length) {
         memset(res->num, 0, res->length * sizeof(unsigned long long));
         res->length = 1;
         return;
     }
-    int i;
+    unsigned long long i;
     for (i = 0; i < res->length - shift_len - 1; i++)
         res->num[i] = (res->num[i + shift_len] >> mod_bits) |
                       ((res->num[i + shift_len + 1] << (63 - mod_bits)) << 1);
@@ -216,7 +578,7 @@ void bn_rshift(bn_t *res, unsigned long long bits)
 
 void bn_mask(bn_t *bn_ptr, unsigned long long mask)
 {
-    for (int i = 0; i < bn_ptr->length; i++)
+    for (unsigned long long i = 0; i < bn_ptr->length; i++)
         bn_ptr->num[i] &= mask;
 }
 // cppcheck-suppress unusedFunction
@@ -224,14 +586,14 @@ bool bn_mult_slow(bn_t *a, bn_t *res)
 {
     bn_shrink(a);
     bn_shrink(res);
-    bn_t sum;
+    bn_t sum = {.arena = res->arena};
     if (!bn_znew(&sum, a->length + res->length))
         return false;
-    bn_t tmp;
+    bn_t tmp = {.arena = res->arena};
     if (!bn_znew(&tmp, a->length + res->length))
         return false;
 
-    for (int i = 0; i < a->length; i++) {
+    for (unsigned long long i = 0; i < a->length; i++) {
         for (int j = 0; j < 64; j++) {
             if (a->num[i] & (1ULL << j)) {
                 bn_move(res, &tmp);
@@ -248,54 +610,1248 @@ bool bn_mult_slow(bn_t *a, bn_t *res)
     return true;
 }
 
-bool bn_mult(bn_t *a, bn_t *res)
+/*
+ * Multiplication works on raw limb arrays (least significant limb first),
+ * in the spirit of GMP's mpn layer. All helpers write into buffers owned by
+ * the caller, temporaries are carved from a single scratch area.
+ */
+
+unsigned int bn_karatsuba_threshold = BN_KARATSUBA_THRESHOLD;
+unsigned int bn_toom3_threshold = BN_TOOM3_THRESHOLD;
+unsigned int bn_ntt_threshold = BN_NTT_THRESHOLD;
+unsigned int bn_parallel_threshold = BN_PARALLEL_THRESHOLD;
+
+/* Runs the parts of large products that go to other CPUs, if there is one */
+static struct workqueue_struct *bn_wq;
+
+/*
+ * Unbound, so the parts spread over all allowed CPUs, and visible in
+ * sysfs, so those can be restricted through its cpumask
+ */
+void bn_workqueue_init(const char *name)
 {
-    bn_shrink(a);
-    bn_shrink(res);
-    bn_t low = {};
-    if (!bn_znew(&low, res->length))
-        return false;
-    bn_t high = {};
-    if (!bn_znew(&high, a->length + res->length + 5))
-        return false;
-    bn_t sum = {};
-    if (!bn_znew(&sum, a->length + res->length + 5))
-        return false;
-    for (int i = 0; i < a->length; i++) {
-        for (int j = 0; j < 64; j += 32) {
-            unsigned long long multiplier = ((a->num[i]) >> j) & 0xffffffffULL;
-            bn_extend(&low, res->length);
-            bn_move(res, &low);
-            bn_extend(&high, res->length);
-            bn_move(res, &high);
-            bn_rshift(&high, 32);
-            bn_mask(&low, 0xffffffffULL);
-
-            bn_mask(&high, 0xffffffffULL);
-            for (int k = 0; k < low.length; k++) {
-                low.num[k] *= multiplier;
+    bn_wq = alloc_workqueue(name, WQ_UNBOUND | WQ_SYSFS, 0);
+}
+
+void bn_workqueue_exit(void)
+{
+    if (bn_wq)
+        destroy_workqueue(bn_wq);
+    bn_wq = NULL;
+}
+
+/* Whether products of n-limb operands are worth splitting across CPUs */
+static bool bn_parallel(unsigned long long n)
+{
+    return bn_wq && bn_parallel_threshold && n >= bn_parallel_threshold &&
+           num_online_cpus() > 1;
+}
+
+/*
+ * d = |a - b| where an >= bn, d has an limbs.
+ * Returns true if a < b.
+ */
+static bool bn_abs_diff(unsigned long long *d,
+                        const unsigned long long *a,
+                        unsigned long long an,
+                        const unsigned long long *b,
+                        unsigned long long bn)
+{
+    unsigned long long i = an;
+    while (i > bn && !a[i - 1])
+        i--;
+    if (i == bn) {
+        while (i > 0 && a[i - 1] == b[i - 1])
+            i--;
+        if (i > 0 && a[i - 1] < b[i - 1]) {
+            bn_sub_n(d, b, a, bn);
+            memset(d + bn, 0, sizeof(unsigned long long) * (an - bn));
+            return true;
+        }
+    }
+    bn_sub_limbs(d, a, an, b, bn);
+    return false;
+}
+
+/* Negate the n-limb two's complement number r */
+static void bn_neg_n(unsigned long long *r, unsigned long long n)
+{
+    unsigned long long carry = 1;
+    for (unsigned long long i = 0; i < n; i++) {
+        r[i] = ~r[i] + carry;
+        carry = carry && !r[i];
+    }
+}
+
+/* Arithmetic right shift by one of the n-limb two's complement number r */
+static void bn_half_n(unsigned long long *r, unsigned long long n)
+{
+    for (unsigned long long i = 0; i < n - 1; i++)
+        r[i] = (r[i] >> 1) | (r[i + 1] << 63);
+    r[n - 1] = (unsigned long long) ((long long) r[n - 1] >> 1);
+}
+
+/*
+ * r = r / 3 for an n-limb number known to be divisible by 3. This is a
+ * multiplication by the inverse of 3 modulo 2^(64n), so it also works on
+ * negative two's complement numbers.
+ */
+static void bn_divexact_by3(unsigned long long *r, unsigned long long n)
+{
+    unsigned long long borrow = 0;
+    for (unsigned long long i = 0; i < n; i++) {
+        unsigned long long s = r[i] - borrow;
+        borrow = s > r[i];
+        unsigned long long q = s * 0xaaaaaaaaaaaaaaabULL;
+        r[i] = q;
+        borrow += (q >= 0x5555555555555556ULL) + (q >= 0xaaaaaaaaaaaaaaabULL);
+    }
+}
+
+/*
+ * Full-width limb products: a 64x64->128 multiply plus up to two 64-bit
+ * addends never overflows 128 bits, so each step of the loops below is a
+ * single widening multiply and add.
+ */
+static inline unsigned long long bn_umul(unsigned long long a,
+                                         unsigned long long b,
+                                         unsigned long long *hi)
+{
+    unsigned __int128 p = (unsigned __int128) a * b;
+    *hi = p >> 64;
+    return (unsigned long long) p;
+}
+
+/* r = a * m + carry, carry = high limb */
+#define BN_MUL_STEP(r, a, m, carry)                                  \
+    do {                                                             \
+        unsigned __int128 __p = (unsigned __int128) (a) * (m) + (carry); \
+        (r) = (unsigned long long) __p;                              \
+        (carry) = __p >> 64;                                         \
+    } while (0)
+
+/* r += a * m + carry, carry = high limb */
+#define BN_ADDMUL_STEP(r, a, m, carry)                                 \
+    do {                                                               \
+        unsigned __int128 __p =                                        \
+            (unsigned __int128) (a) * (m) + (r) + (carry);             \
+        (r) = (unsigned long long) __p;                                \
+        (carry) = __p >> 64;                                           \
+    } while (0)
+
+/* r = a * m, returns the high limb */
+static unsigned long long bn_mul_1(unsigned long long *r,
+                                   const unsigned long long *a,
+                                   unsigned long long n,
+                                   unsigned long long m)
+{
+    unsigned long long carry = 0, i = 0;
+    for (; i + 4 <= n; i += 4) {
+        BN_MUL_STEP(r[i], a[i], m, carry);
+        BN_MUL_STEP(r[i + 1], a[i + 1], m, carry);
+        BN_MUL_STEP(r[i + 2], a[i + 2], m, carry);
+        BN_MUL_STEP(r[i + 3], a[i + 3], m, carry);
+    }
+    for (; i < n; i++)
+        BN_MUL_STEP(r[i], a[i], m, carry);
+    return carry;
+}
+
+/* r += a * m, returns the high limb */
+static unsigned long long bn_addmul_1_generic(unsigned long long *r,
+                                              const unsigned long long *a,
+                                              unsigned long long n,
+                                              unsigned long long m)
+{
+    unsigned long long carry = 0, i = 0;
+    for (; i + 4 <= n; i += 4) {
+        BN_ADDMUL_STEP(r[i], a[i], m, carry);
+        BN_ADDMUL_STEP(r[i + 1], a[i + 1], m, carry);
+        BN_ADDMUL_STEP(r[i + 2], a[i + 2], m, carry);
+        BN_ADDMUL_STEP(r[i + 3], a[i + 3], m, carry);
+    }
+    for (; i < n; i++)
+        BN_ADDMUL_STEP(r[i], a[i], m, carry);
+    return carry;
+}
+
+#ifdef CONFIG_X86_64
+/* Set at load on CPUs with ADX and BMI2 */
+static DEFINE_STATIC_KEY_FALSE(bn_adx);
+
+/*
+ * r += a * m with mulx, which leaves the flags alone, and two carry chains
+ * at once: adcx carries the high limbs of the products in CF, adox the
+ * limbs of r in OF. lea and jrcxz keep the loop control off both flags.
+ * The n % 4 limbs in front go through the generic loop.
+ */
+#define BN_ADX_STEP(off, lo, hi, prev)                      \
+    "mulx " off "(%[a],%[i],8), %[" lo "], %[" hi "]\n\t" \
+    "adcx %[" prev "], %[" lo "]\n\t"                     \
+    "adox " off "(%[r],%[i],8), %[" lo "]\n\t"            \
+    "mov %[" lo "], " off "(%[r],%[i],8)\n\t"
+
+static unsigned long long bn_addmul_1_adx(unsigned long long *r,
+                                          const unsigned long long *a,
+                                          unsigned long long n,
+                                          unsigned long long m)
+{
+    unsigned long long i = n % 4, q = n / 4, lo, h2;
+    unsigned long long hi = bn_addmul_1_generic(r, a, i, m);
+
+    if (!q)
+        return hi;
+    asm volatile("xor %k[lo], %k[lo]\n\t"
+                 "1:\n\t" BN_ADX_STEP("", "lo", "h2", "hi")
+                 BN_ADX_STEP("8", "lo", "hi", "h2")
+                 BN_ADX_STEP("16", "lo", "h2", "hi")
+                 BN_ADX_STEP("24", "lo", "hi", "h2")
+                 "lea 4(%[i]), %[i]\n\t"
+                 "lea -1(%[q]), %[q]\n\t"
+                 "jrcxz 2f\n\t"
+                 "jmp 1b\n"
+                 "2:\n\t"
+                 "mov $0, %k[lo]\n\t"
+                 "adcx %[lo], %[hi]\n\t"
+                 "adox %[lo], %[hi]"
+                 : [hi] "+&r"(hi), [i] "+&r"(i), [q] "+&c"(q),
+                   [lo] "=&r"(lo), [h2] "=&r"(h2)
+                 : [r] "r"(r), [a] "r"(a), "d"(m)
+                 : "cc", "memory");
+    return hi;
+}
+#endif
+
+static unsigned long long bn_addmul_1(unsigned long long *r,
+                                      const unsigned long long *a,
+                                      unsigned long long n,
+                                      unsigned long long m)
+{
+#ifdef CONFIG_X86_64
+    if (static_branch_likely(&bn_adx))
+        return bn_addmul_1_adx(r, a, n, m);
+#endif
+    return bn_addmul_1_generic(r, a, n, m);
+}
+
+void bn_cpu_init(void)
+{
+#ifdef CONFIG_X86_64
+    if (boot_cpu_has(X86_FEATURE_ADX) && boot_cpu_has(X86_FEATURE_BMI2))
+        static_branch_enable(&bn_adx);
+#endif
+}
+
+/* r = a * b, schoolbook. r has an + bn limbs and must not overlap a or b */
+static void bn_mul_basecase(unsigned long long *r,
+                            const unsigned long long *a,
+                            unsigned long long an,
+                            const unsigned long long *b,
+                            unsigned long long bn)
+{
+    r[an] = bn_mul_1(r, a, an, b[0]);
+    for (unsigned long long i = 1; i < bn; i++)
+        r[an + i] = bn_addmul_1(r + i, a, an, b[i]);
+}
+
+/*
+ * The Karatsuba and Toom-3 thresholds a product runs with, read once per
+ * product: they are module parameters, and one that changed between sizing
+ * the scratch and dispatching would take an algorithm into no scratch.
+ */
+struct bn_mul_cut {
+    unsigned int karatsuba, toom3;
+};
+
+static void bn_mul_cut_get(struct bn_mul_cut *cut)
+{
+    cut->karatsuba = max(READ_ONCE(bn_karatsuba_threshold), 8U);
+    cut->toom3 = max(READ_ONCE(bn_toom3_threshold), 48U);
+}
+
+static void bn_mul_limbs(unsigned long long *r,
+                         const unsigned long long *a,
+                         unsigned long long an,
+                         const unsigned long long *b,
+                         unsigned long long bn,
+                         unsigned long long *scratch,
+                         const struct bn_mul_cut *cut);
+
+/*
+ * r = a * b where b is at most half as long as a: multiply a in
+ * b-sized chunks and accumulate.
+ */
+static void bn_mul_unbalanced(unsigned long long *r,
+                              const unsigned long long *a,
+                              unsigned long long an,
+                              const unsigned long long *b,
+                              unsigned long long bn,
+                              unsigned long long *scratch,
+                              const struct bn_mul_cut *cut)
+{
+    unsigned long long *t = scratch, *next = scratch + 2 * bn;
+
+    bn_mul_limbs(r, a, bn, b, bn, next, cut);
+    memset(r + 2 * bn, 0, sizeof(unsigned long long) * (an - bn));
+    for (unsigned long long off = bn; off < an; off += bn) {
+        unsigned long long len = min(bn, an - off);
+        bn_mul_limbs(t, a + off, len, b, bn, next, cut);
+        bn_add_limbs(r + off, r + off, an + bn - off, t, len + bn);
+    }
+}
+
+/*
+ * Karatsuba: with a = a1 * B^h + a0 and b = b1 * B^h + b0,
+ * a * b = z2 * B^2h + (z0 + z2 - (a0 - a1)(b0 - b1)) * B^h + z0,
+ * where z0 = a0 * b0 and z2 = a1 * b1. Requires h < bn <= an.
+ */
+static void bn_mul_karatsuba(unsigned long long *r,
+                             const unsigned long long *a,
+                             unsigned long long an,
+                             const unsigned long long *b,
+                             unsigned long long bn,
+                             unsigned long long *scratch,
+                             const struct bn_mul_cut *cut)
+{
+    unsigned long long h = (an + 1) / 2;
+    unsigned long long *t = scratch;
+    unsigned long long *da = scratch + 2 * h, *db = da + h;
+    unsigned long long *mid = da;
+    unsigned long long *next = scratch + 4 * h + 1;
+
+    bool neg = bn_abs_diff(da, a, h, a + h, an - h) ^
+               bn_abs_diff(db, b, h, b + h, bn - h);
+    bn_mul_limbs(t, da, h, db, h, next, cut);
+    bn_mul_limbs(r, a, h, b, h, next, cut);
+    bn_mul_limbs(r + 2 * h, a + h, an - h, b + h, bn - h, next, cut);
+
+    /* mid = z0 + z2 -/+ |a0 - a1||b0 - b1| */
+    mid[2 * h] = bn_add_limbs(mid, r, 2 * h, r + 2 * h, an + bn - 2 * h);
+    if (neg)
+        bn_add_limbs(mid, mid, 2 * h + 1, t, 2 * h);
+    else
+        bn_sub_limbs(mid, mid, 2 * h + 1, t, 2 * h);
+    bn_add_limbs(r + h, r + h, an + bn - h, mid, min(2 * h + 1, an + bn - h));
+}
+
+/*
+ * Recover the coefficients c0..c4 of a product polynomial from its values
+ * v0 (in r), v1, vm1, v2 (w = 2k + 2 limbs each) and vinf (in r + 4k),
+ * then sum them into the n-limb result r. Clobbers v1, vm1 and v2.
+ */
+static void bn_toom3_interpolate(unsigned long long *r,
+                                 unsigned long long n,
+                                 unsigned long long k,
+                                 unsigned long long *v1,
+                                 unsigned long long *vm1,
+                                 unsigned long long *v2)
+{
+    unsigned long long w = 2 * k + 2;
+    unsigned long long *v0 = r, *vinf = r + 4 * k;
+
+    /* v2 = (v2 - vm1) / 3 = c1 + c2 + 3c3 + 5c4 */
+    bn_sub_n(v2, v2, vm1, w);
+    bn_divexact_by3(v2, w);
+    /* vm1 = (v1 - vm1) / 2 = c1 + c3 */
+    bn_sub_n(vm1, v1, vm1, w);
+    bn_half_n(vm1, w);
+    /* v1 = v1 - v0 = c1 + c2 + c3 + c4 */
+    bn_sub_limbs(v1, v1, w, v0, 2 * k);
+    /* v2 = (v2 - v1) / 2 - 2c4 = c3 */
+    bn_sub_n(v2, v2, v1, w);
+    bn_half_n(v2, w);
+    bn_sub_limbs(v2, v2, w, vinf, n - 4 * k);
+    bn_sub_limbs(v2, v2, w, vinf, n - 4 * k);
+    /* v1 = v1 - (c1 + c3) - c4 = c2 */
+    bn_sub_n(v1, v1, vm1, w);
+    bn_sub_limbs(v1, v1, w, vinf, n - 4 * k);
+    /* vm1 = (c1 + c3) - c3 = c1 */
+    bn_sub_n(vm1, vm1, v2, w);
+
+    memset(r + 2 * k, 0, sizeof(unsigned long long) * 2 * k);
+    bn_add_limbs(r + k, r + k, n - k, vm1, min(w, n - k));
+    bn_add_limbs(r + 2 * k, r + 2 * k, n - 2 * k, v1, min(w, n - 2 * k));
+    bn_add_limbs(r + 3 * k, r + 3 * k, n - 3 * k, v2, min(w, n - 3 * k));
+}
+
+/*
+ * Toom-3: split a and b into three k-limb pieces, evaluate the product
+ * polynomial c4 x^4 + ... + c0 at 0, 1, -1, 2 and infinity, then
+ * interpolate. The value at -1 may be negative, so the w-limb
+ * intermediates use two's complement. Requires 2k < bn <= an.
+ */
+static void bn_mul_toom3(unsigned long long *r,
+                         const unsigned long long *a,
+                         unsigned long long an,
+                         const unsigned long long *b,
+                         unsigned long long bn,
+                         unsigned long long *scratch,
+                         const struct bn_mul_cut *cut)
+{
+    unsigned long long k = (an + 2) / 3, w = 2 * k + 2;
+    unsigned long long a2n = an - 2 * k, b2n = bn - 2 * k;
+    unsigned long long *v1 = scratch, *vm1 = v1 + w, *v2 = vm1 + w;
+    unsigned long long *ea = v2 + w, *eb = ea + k + 1;
+    unsigned long long *ta = eb + k + 1, *tb = ta + k + 1;
+    unsigned long long *next = tb + k + 1;
+    const unsigned long long *a1 = a + k, *a2 = a + 2 * k;
+    const unsigned long long *b1 = b + k, *b2 = b + 2 * k;
+
+    bn_mul_limbs(r, a, k, b, k, next, cut);
+    bn_mul_limbs(r + 4 * k, a2, a2n, b2, b2n, next, cut);
+
+    /* ea = a0 + a2, eb = b0 + b2 */
+    ea[k] = bn_add_limbs(ea, a, k, a2, a2n);
+    eb[k] = bn_add_limbs(eb, b, k, b2, b2n);
+
+    /* vm1 = (a0 - a1 + a2)(b0 - b1 + b2) */
+    bool neg = bn_abs_diff(ta, ea, k + 1, a1, k) ^
+               bn_abs_diff(tb, eb, k + 1, b1, k);
+    bn_mul_limbs(vm1, ta, k + 1, tb, k + 1, next, cut);
+    if (neg)
+        bn_neg_n(vm1, w);
+
+    /* v1 = (a0 + a1 + a2)(b0 + b1 + b2) */
+    bn_add_limbs(ta, ea, k + 1, a1, k);
+    bn_add_limbs(tb, eb, k + 1, b1, k);
+    bn_mul_limbs(v1, ta, k + 1, tb, k + 1, next, cut);
+
+    /* v2 = (a0 + 2a1 + 4a2)(b0 + 2b1 + 4b2), as 2(ta + a2) - a0 */
+    bn_add_limbs(ta, ta, k + 1, a2, a2n);
+    bn_add_n(ta, ta, ta, k + 1);
+    bn_sub_limbs(ta, ta, k + 1, a, k);
+    bn_add_limbs(tb, tb, k + 1, b2, b2n);
+    bn_add_n(tb, tb, tb, k + 1);
+    bn_sub_limbs(tb, tb, k + 1, b, k);
+    bn_mul_limbs(v2, ta, k + 1, tb, k + 1, next, cut);
+
+    bn_toom3_interpolate(r, an + bn, k, v1, vm1, v2);
+}
+
+/*
+ * r = a * b, r has an + bn limbs and must not overlap a or b.
+ * scratch must hold BN_MUL_SCRATCH(max(an, bn)) limbs.
+ */
+static void bn_mul_limbs(unsigned long long *r,
+                         const unsigned long long *a,
+                         unsigned long long an,
+                         const unsigned long long *b,
+                         unsigned long long bn,
+                         unsigned long long *scratch,
+                         const struct bn_mul_cut *cut)
+{
+    if (an < bn) {
+        swap(a, b);
+        swap(an, bn);
+    }
+    if (bn < cut->karatsuba)
+        bn_mul_basecase(r, a, an, b, bn);
+    else if (bn <= (an + 1) / 2)
+        bn_mul_unbalanced(r, a, an, b, bn, scratch, cut);
+    else if (bn >= cut->toom3 && bn > 2 * ((an + 2) / 3))
+        bn_mul_toom3(r, a, an, b, bn, scratch, cut);
+    else
+        bn_mul_karatsuba(r, a, an, b, bn, scratch, cut);
+}
+
+/* r = a^2, schoolbook computing every cross product once. r has 2n limbs */
+static void bn_sqr_basecase(unsigned long long *r,
+                            const unsigned long long *a,
+                            unsigned long long n)
+{
+    r[0] = 0;
+    r[2 * n - 1] = 0;
+    if (n > 1) {
+        r[n] = bn_mul_1(r + 1, a + 1, n - 1, a[0]);
+        for (unsigned long long i = 1; i < n - 1; i++)
+            r[n + i] = bn_addmul_1(r + 2 * i + 1, a + i + 1, n - i - 1, a[i]);
+    }
+    bn_add_n(r, r, r, 2 * n);
+
+    unsigned long long carry = 0;
+    for (unsigned long long i = 0; i < n; i++) {
+        unsigned long long hi, lo = bn_umul(a[i], a[i], &hi);
+        unsigned long long s = r[2 * i] + carry;
+        carry = s < carry;
+        s += lo;
+        carry += s < lo;
+        r[2 * i] = s;
+        s = r[2 * i + 1] + carry;
+        carry = s < carry;
+        s += hi;
+        carry += s < hi;
+        r[2 * i + 1] = s;
+    }
+}
+
+static void bn_sqr_limbs(unsigned long long *r,
+                         const unsigned long long *a,
+                         unsigned long long n,
+                         unsigned long long *scratch,
+                         const struct bn_mul_cut *cut);
+
+/* Karatsuba squaring: the middle term is z0 + z2 - (a0 - a1)^2 */
+static void bn_sqr_karatsuba(unsigned long long *r,
+                             const unsigned long long *a,
+                             unsigned long long n,
+                             unsigned long long *scratch,
+                             const struct bn_mul_cut *cut)
+{
+    unsigned long long h = (n + 1) / 2;
+    unsigned long long *t = scratch;
+    unsigned long long *d = scratch + 2 * h, *mid = d;
+    unsigned long long *next = scratch + 4 * h + 1;
+
+    bn_abs_diff(d, a, h, a + h, n - h);
+    bn_sqr_limbs(t, d, h, next, cut);
+    bn_sqr_limbs(r, a, h, next, cut);
+    bn_sqr_limbs(r + 2 * h, a + h, n - h, next, cut);
+
+    mid[2 * h] = bn_add_limbs(mid, r, 2 * h, r + 2 * h, 2 * n - 2 * h);
+    bn_sub_limbs(mid, mid, 2 * h + 1, t, 2 * h);
+    bn_add_limbs(r + h, r + h, 2 * n - h, mid, min(2 * h + 1, 2 * n - h));
+}
+
+/* Toom-3 squaring, all five evaluations are squares */
+static void bn_sqr_toom3(unsigned long long *r,
+                         const unsigned long long *a,
+                         unsigned long long n,
+                         unsigned long long *scratch,
+                         const struct bn_mul_cut *cut)
+{
+    unsigned long long k = (n + 2) / 3, w = 2 * k + 2;
+    unsigned long long a2n = n - 2 * k;
+    unsigned long long *v1 = scratch, *vm1 = v1 + w, *v2 = vm1 + w;
+    unsigned long long *ea = v2 + w, *ta = ea + k + 1;
+    unsigned long long *next = ta + k + 1;
+    const unsigned long long *a1 = a + k, *a2 = a + 2 * k;
+
+    bn_sqr_limbs(r, a, k, next, cut);
+    bn_sqr_limbs(r + 4 * k, a2, a2n, next, cut);
+
+    ea[k] = bn_add_limbs(ea, a, k, a2, a2n);
+    bn_abs_diff(ta, ea, k + 1, a1, k);
+    bn_sqr_limbs(vm1, ta, k + 1, next, cut);
+
+    bn_add_limbs(ta, ea, k + 1, a1, k);
+    bn_sqr_limbs(v1, ta, k + 1, next, cut);
+
+    bn_add_limbs(ta, ta, k + 1, a2, a2n);
+    bn_add_n(ta, ta, ta, k + 1);
+    bn_sub_limbs(ta, ta, k + 1, a, k);
+    bn_sqr_limbs(v2, ta, k + 1, next, cut);
+
+    bn_toom3_interpolate(r, 2 * n, k, v1, vm1, v2);
+}
+
+/*
+ * r = a^2, r has 2n limbs and must not overlap a.
+ * scratch must hold BN_MUL_SCRATCH(n) limbs.
+ */
+static void bn_sqr_limbs(unsigned long long *r,
+                         const unsigned long long *a,
+                         unsigned long long n,
+                         unsigned long long *scratch,
+                         const struct bn_mul_cut *cut)
+{
+    if (n < cut->karatsuba)
+        bn_sqr_basecase(r, a, n);
+    else if (n >= cut->toom3)
+        bn_sqr_toom3(r, a, n, scratch, cut);
+    else
+        bn_sqr_karatsuba(r, a, n, scratch, cut);
+}
+
+/*
+ * Number-theoretic transform multiplication for the largest operands.
+ *
+ * Limbs are used directly as coefficients and the cyclic convolution is
+ * computed modulo three primes p < 2^62 with 2^48 | p - 1. Every
+ * coefficient of the product is below min(an, bn) * 2^128, well under
+ * p1 * p2 * p3 ~ 2^186, so Garner's CRT recovers it exactly. Arithmetic
+ * mod p is Montgomery multiplication with R = 2^64; only the prime and a
+ * quadratic non-residue are stored, everything else is derived per call.
+ */
+#define BN_NTT_PRIMES 3
+
+static const struct {
+    unsigned long long p;
+    unsigned long long g; /* quadratic non-residue */
+} bn_ntt_primes[BN_NTT_PRIMES] = {
+    {0x3fdc000000000001ULL, 3},
+    {0x3fc6000000000001ULL, 5},
+    {0x3fa3000000000001ULL, 3},
+};
+
+struct bn_ntt_mod {
+    unsigned long long p;
+    unsigned long long pinv; /* -p^-1 mod 2^64 */
+    unsigned long long r1;   /* R mod p */
+    unsigned long long r2;   /* R^2 mod p */
+};
+
+/* x * y / R mod p */
+static inline unsigned long long bn_ntt_mul(unsigned long long x,
+                                            unsigned long long y,
+                                            const struct bn_ntt_mod *m)
+{
+    unsigned __int128 t = (unsigned __int128) x * y;
+    unsigned long long q = (unsigned long long) t * m->pinv;
+    unsigned long long r = (t + (unsigned __int128) q * m->p) >> 64;
+    return r >= m->p ? r - m->p : r;
+}
+
+static inline unsigned long long bn_ntt_add(unsigned long long x,
+                                            unsigned long long y,
+                                            const struct bn_ntt_mod *m)
+{
+    x += y;
+    return x >= m->p ? x - m->p : x;
+}
+
+static inline unsigned long long bn_ntt_sub(unsigned long long x,
+                                            unsigned long long y,
+                                            const struct bn_ntt_mod *m)
+{
+    return x >= y ? x - y : x + m->p - y;
+}
+
+/* x^e in Montgomery form, x in Montgomery form */
+static unsigned long long bn_ntt_pow(unsigned long long x,
+                                     unsigned long long e,
+                                     const struct bn_ntt_mod *m)
+{
+    unsigned long long r = m->r1;
+    for (; e; e >>= 1) {
+        if (e & 1)
+            r = bn_ntt_mul(r, x, m);
+        x = bn_ntt_mul(x, x, m);
+    }
+    return r;
+}
+
+static void bn_ntt_init(struct bn_ntt_mod *m, unsigned long long p)
+{
+    unsigned long long inv = p;
+    /* Newton iteration, each step doubles the correct low bits */
+    for (int i = 0; i < 5; i++)
+        inv *= 2 - p * inv;
+    m->p = p;
+    m->pinv = -inv;
+    m->r1 = -p % p;
+    m->r2 = m->r1;
+    for (int i = 0; i < 64; i++)
+        m->r2 = bn_ntt_add(m->r2, m->r2, m);
+}
+
+/*
+ * Decimation in frequency: natural order in, bit-reversed order out.
+ * tw[len + j] = w^j for the 2len-th root of unity w and j < len, so every
+ * pass walks its twiddles contiguously.
+ */
+static void bn_ntt_forward(unsigned long long *f,
+                           unsigned long long n,
+                           const unsigned long long *tw,
+                           const struct bn_ntt_mod *mp)
+{
+    /* a local copy, so stores to f cannot alias the modulus */
+    const struct bn_ntt_mod mod = *mp, *m = &mod;
+
+    for (unsigned long long len = n / 2; len; len /= 2) {
+        const unsigned long long *w = tw + len;
+        for (unsigned long long *x = f, *y = f + len; x < f + n;
+             x += 2 * len, y += 2 * len) {
+            for (unsigned long long j = 0; j < len; j++) {
+                unsigned long long u = x[j], v = y[j];
+                x[j] = bn_ntt_add(u, v, m);
+                y[j] = bn_ntt_mul(bn_ntt_sub(u, v, m), w[j], m);
             }
-            for (int k = 0; k < high.length; k++) {
-                high.num[k] *= multiplier;
+        }
+    }
+}
+
+/*
+ * Decimation in time with w^-1: bit-reversed order in, natural order out,
+ * scaled by N. w^-j = -w^(len - j), so the forward table is reused.
+ */
+static void bn_ntt_inverse(unsigned long long *f,
+                           unsigned long long n,
+                           const unsigned long long *tw,
+                           const struct bn_ntt_mod *mp)
+{
+    /* a local copy, so stores to f cannot alias the modulus */
+    const struct bn_ntt_mod mod = *mp, *m = &mod;
+
+    for (unsigned long long len = 1; len < n; len *= 2) {
+        const unsigned long long *w = tw + 2 * len;
+        for (unsigned long long *x = f, *y = f + len; x < f + n;
+             x += 2 * len, y += 2 * len) {
+            unsigned long long u = x[0], v = y[0];
+            x[0] = bn_ntt_add(u, v, m);
+            y[0] = bn_ntt_sub(u, v, m);
+            for (unsigned long long j = 1; j < len; j++) {
+                u = x[j];
+                v = bn_ntt_mul(y[j], w[-j], m);
+                x[j] = bn_ntt_sub(u, v, m);
+                y[j] = bn_ntt_add(u, v, m);
             }
-            bn_lshift(&high, 32);
-            bn_extend(&high, low.length + 1);
-            bn_add_carry(&low, &high, 0);
-            bn_lshift(&high, i * 64 + j);
-            bn_extend(&sum, high.length + 1);
-            bn_add_carry(&high, &sum, 0);
         }
     }
-    bn_swap(&sum, res);
-    bn_free(&sum);
-    bn_free(&low);
-    bn_free(&high);
+}
+
+/* f = f * g * scale / R^2 */
+static void bn_ntt_pointwise(unsigned long long *f,
+                             const unsigned long long *g,
+                             unsigned long long n,
+                             unsigned long long scale,
+                             const struct bn_ntt_mod *mp)
+{
+    const struct bn_ntt_mod mod = *mp, *m = &mod;
+
+    for (unsigned long long i = 0; i < n; i++)
+        f[i] = bn_ntt_mul(bn_ntt_mul(f[i], g[i], m), scale, m);
+}
+
+static void bn_ntt_load(unsigned long long *f,
+                        unsigned long long n,
+                        const unsigned long long *a,
+                        unsigned long long an,
+                        unsigned long long p)
+{
+    for (unsigned long long i = 0; i < an; i++)
+        f[i] = a[i] % p;
+    memset(f + an, 0, sizeof(unsigned long long) * (n - an));
+}
+
+/* Transform length for a product of len limbs */
+static unsigned long long bn_ntt_size(unsigned long long len)
+{
+    unsigned long long n = 1;
+    while (n < len)
+        n *= 2;
+    return n;
+}
+
+/*
+ * Scratch needed by bn_mul_ntt for a product of len limbs, par gives every
+ * prime its own transform of b and twiddles
+ */
+static unsigned long long bn_ntt_scratch(unsigned long long len, bool par)
+{
+    return (BN_NTT_PRIMES + (par ? 2 * BN_NTT_PRIMES : 2)) * bn_ntt_size(len);
+}
+
+/* The product modulo one prime, transformed back into fa */
+struct bn_ntt_job {
+    struct work_struct work;
+    unsigned long long *fa, *fb, *tw;
+    const unsigned long long *a, *b;
+    unsigned long long an, bn, n;
+    int prime;
+    struct bn_ntt_mod m;
+};
+
+static void bn_ntt_prime(struct bn_ntt_job *job)
+{
+    struct bn_ntt_mod *m = &job->m;
+    unsigned long long *fa = job->fa, *fb = job->fb, *tw = job->tw;
+    unsigned long long n = job->n, p = bn_ntt_primes[job->prime].p;
+    bool square = job->a == job->b && job->an == job->bn;
+
+    bn_ntt_init(m, p);
+    unsigned long long g = bn_ntt_mul(bn_ntt_primes[job->prime].g, m->r2, m);
+    unsigned long long w = bn_ntt_pow(g, (p - 1) / n, m);
+    tw[n / 2] = m->r1;
+    for (unsigned long long j = n / 2 + 1; j < n; j++)
+        tw[j] = bn_ntt_mul(tw[j - 1], w, m);
+    for (unsigned long long j = n / 2 - 1; j; j--)
+        tw[j] = tw[2 * j];
+
+    bn_ntt_load(fa, n, job->a, job->an, p);
+    bn_ntt_forward(fa, n, tw, m);
+    if (!square) {
+        bn_ntt_load(fb, n, job->b, job->bn, p);
+        bn_ntt_forward(fb, n, tw, m);
+    }
+
+    /*
+     * Pointwise products carry an extra 1/R; fold it, 1/N and the
+     * conversion out of Montgomery form into one constant R^2 / N.
+     */
+    unsigned long long r3 = bn_ntt_mul(m->r2, m->r2, m);
+    unsigned long long scale = bn_ntt_mul(p - (p - 1) / n, r3, m);
+    bn_ntt_pointwise(fa, square ? fa : fb, n, scale, m);
+    bn_ntt_inverse(fa, n, tw, m);
+}
+
+static void bn_ntt_work(struct work_struct *work)
+{
+    bn_ntt_prime(container_of(work, struct bn_ntt_job, work));
+}
+
+/*
+ * r = a * b, r has an + bn limbs and must not overlap a or b; b == a
+ * squares with one forward transform per prime. With par the primes after
+ * the first are transformed on bn_wq while this thread does the first.
+ * scratch must hold bn_ntt_scratch(an + bn, par) limbs.
+ */
+static void bn_mul_ntt(unsigned long long *r,
+                       const unsigned long long *a,
+                       unsigned long long an,
+                       const unsigned long long *b,
+                       unsigned long long bn,
+                       unsigned long long *scratch,
+                       bool par)
+{
+    unsigned long long n = bn_ntt_size(an + bn);
+    struct bn_ntt_job jobs[BN_NTT_PRIMES];
+
+    for (int i = 0; i < BN_NTT_PRIMES; i++) {
+        struct bn_ntt_job *job = &jobs[i];
+        job->fa = scratch + i * n;
+        job->fb = scratch + BN_NTT_PRIMES * n + (par ? 2 * i * n : 0);
+        job->tw = job->fb + n;
+        job->a = a;
+        job->an = an;
+        job->b = b;
+        job->bn = bn;
+        job->n = n;
+        job->prime = i;
+        if (par && i) {
+            INIT_WORK_ONSTACK(&job->work, bn_ntt_work);
+            queue_work(bn_wq, &job->work);
+        }
+    }
+    for (int i = 0; i < BN_NTT_PRIMES; i++) {
+        if (par && i) {
+            flush_work(&jobs[i].work);
+            destroy_work_on_stack(&jobs[i].work);
+        } else {
+            bn_ntt_prime(&jobs[i]);
+        }
+    }
+
+    /*
+     * Garner: x = x0 + p0 * y1 + p0 * p1 * y2 with x0, x1, x2 the residues.
+     * The inverses are kept in Montgomery form, so multiplying a plain
+     * residue by them gives a plain result.
+     */
+    const struct bn_ntt_mod mod1 = jobs[1].m, mod2 = jobs[2].m;
+    const struct bn_ntt_mod *m1 = &mod1, *m2 = &mod2;
+    unsigned long long p0 = jobs[0].m.p, p1 = m1->p, p2 = m2->p;
+    unsigned long long p01_hi, p01_lo = bn_umul(p0, p1, &p01_hi);
+    unsigned long long inv0 =
+        bn_ntt_pow(bn_ntt_mul(p0 - p1, m1->r2, m1), p1 - 2, m1);
+    unsigned long long p0m = bn_ntt_mul(p0 - p2, m2->r2, m2);
+    unsigned long long p01 = bn_ntt_mul(p0m, p1 - p2, m2);
+    unsigned long long inv01 =
+        bn_ntt_pow(bn_ntt_mul(p01, m2->r2, m2), p2 - 2, m2);
+    unsigned long long c0 = 0, c1 = 0;
+
+    /* p0 > p1 > p2 > p0 / 2, so one subtraction reduces x0 mod p1, p2 */
+    for (unsigned long long i = 0; i < an + bn; i++) {
+        unsigned long long x0 = jobs[0].fa[i], x1 = jobs[1].fa[i];
+        unsigned long long x2 = jobs[2].fa[i];
+        unsigned long long y1, y2, lo, mid, hi;
+        unsigned __int128 t;
+
+        y1 = bn_ntt_sub(x1, x0 >= p1 ? x0 - p1 : x0, m1);
+        y1 = bn_ntt_mul(y1, inv0, m1);
+        y2 = bn_ntt_add(x0 >= p2 ? x0 - p2 : x0, bn_ntt_mul(y1, p0m, m2), m2);
+        y2 = bn_ntt_mul(bn_ntt_sub(x2, y2, m2), inv01, m2);
+
+        t = (unsigned __int128) p0 * y1 + x0;
+        lo = t;
+        mid = t >> 64;
+        t = (unsigned __int128) p01_lo * y2 + lo;
+        lo = t;
+        t = (unsigned __int128) p01_hi * y2 + mid +
+            (unsigned long long) (t >> 64);
+        mid = t;
+        hi = t >> 64;
+
+        t = (unsigned __int128) lo + c0;
+        r[i] = t;
+        t = (unsigned __int128) mid + c1 + (unsigned long long) (t >> 64);
+        c0 = t;
+        c1 = hi + (unsigned long long) (t >> 64);
+    }
+}
+
+/* A product of bn_mul_many, computed into prod */
+struct bn_mul_job {
+    struct work_struct work;
+    bn_t prod;
+    const unsigned long long *a, *b;
+    unsigned long long an, bn;
+    unsigned long long *scratch;
+    struct bn_mul_cut cut;
+    bool ntt, par; /* par splits the NTT primes across CPUs */
+    bool queued;   /* runs on bn_wq */
+};
+
+/* Storage for res = a * res, allocated before any product runs */
+static bool bn_mul_prepare(struct bn_mul_job *job, bn_t *a, bn_t *res)
+{
+    bn_shrink(a);
     bn_shrink(res);
+    job->prod = (bn_t){.arena = res->arena};
+    job->a = a->num;
+    job->an = a->length;
+    job->b = res->num;
+    job->bn = res->length;
+    job->scratch = NULL;
+    bn_mul_cut_get(&job->cut);
+
+    unsigned long long n = min(job->an, job->bn);
+    job->ntt = n >= READ_ONCE(bn_ntt_threshold);
+    job->par = job->ntt && bn_parallel(n);
+    job->queued = false;
+    return bn_new(&job->prod, job->an + job->bn);
+}
+
+/* Scratch the product needs, 0 for none */
+static unsigned long long bn_mul_scratch_len(const struct bn_mul_job *job)
+{
+    if (job->ntt)
+        return bn_ntt_scratch(job->prod.length, job->par);
+    if (min(job->an, job->bn) >= job->cut.karatsuba)
+        return BN_MUL_SCRATCH(max(job->an, job->bn));
+    return 0;
+}
+
+static void bn_mul_run(struct bn_mul_job *job)
+{
+    if (job->ntt)
+        bn_mul_ntt(job->prod.num, job->a, job->an, job->b, job->bn,
+                   job->scratch, job->par);
+    else if (job->a == job->b && job->an == job->bn)
+        bn_sqr_limbs(job->prod.num, job->a, job->an, job->scratch,
+                     &job->cut);
+    else
+        bn_mul_limbs(job->prod.num, job->a, job->an, job->b, job->bn,
+                     job->scratch, &job->cut);
+}
+
+static void bn_mul_work(struct work_struct *work)
+{
+    bn_mul_run(container_of(work, struct bn_mul_job, work));
+}
+
+/*
+ * Scratch shared by the jobs in jobs[0..n) whose queued flag equals
+ * queued, which run one after another. Failing that, their NTT primes are
+ * made to go one after another in less memory.
+ */
+static bool bn_mul_scratch_get(struct bn_arena *arena,
+                               struct bn_mul_job *jobs,
+                               int n,
+                               bool queued,
+                               unsigned long long **scratch)
+{
+    for (int retry = 0; retry < 2; retry++) {
+        unsigned long long len = 0;
+        for (int i = 0; i < n; i++) {
+            if (jobs[i].queued == queued) {
+                jobs[i].par &= !retry;
+                len = max(len, bn_mul_scratch_len(&jobs[i]));
+            }
+        }
+        if (!len || (*scratch = bn_scratch_get(arena, len)))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Computes up to BN_MUL_MAX independent products. Those past the first
+ * that are large enough run on bn_wq, the rest on this thread, so a
+ * doubling step's products can use several CPUs at once. The arena is not
+ * shared between threads, so all memory is taken before any product runs.
+ */
+bool bn_mul_many(struct bn_mul_op *ops, int n)
+{
+    struct bn_arena *arena = ops[0].res->arena;
+    struct bn_mul_job jobs[BN_MUL_MAX];
+    unsigned long long *scratch = NULL;
+    bool err = false;
+    int i;
+
+    for (i = 0; i < n && !err; i++) {
+        err = !bn_mul_prepare(&jobs[i], ops[i].a ? ops[i].a : ops[i].res,
+                              ops[i].res);
+        jobs[i].queued = i && bn_parallel(min(jobs[i].an, jobs[i].bn));
+    }
+    err = err || !bn_mul_scratch_get(arena, jobs, n, false, &scratch);
+    for (int j = 0; j < n && !err; j++) {
+        if (jobs[j].queued)
+            err = !bn_mul_scratch_get(arena, &jobs[j], 1, true,
+                                      &jobs[j].scratch);
+    }
+    if (err) {
+        bn_scratch_put(arena, scratch);
+        while (i--) {
+            bn_scratch_put(arena, jobs[i].scratch);
+            bn_free(&jobs[i].prod);
+        }
+        return false;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (jobs[i].queued) {
+            INIT_WORK_ONSTACK(&jobs[i].work, bn_mul_work);
+            queue_work(bn_wq, &jobs[i].work);
+        }
+    }
+    for (i = 0; i < n; i++) {
+        if (!jobs[i].queued) {
+            jobs[i].scratch = scratch;
+            bn_mul_run(&jobs[i]);
+        }
+    }
+    bn_scratch_put(arena, scratch);
+    for (i = 0; i < n; i++) {
+        if (jobs[i].queued) {
+            flush_work(&jobs[i].work);
+            destroy_work_on_stack(&jobs[i].work);
+            bn_scratch_put(arena, jobs[i].scratch);
+        }
+    }
+    /* only now, as a res may still be read as another product's operand */
+    for (i = 0; i < n; i++) {
+        bn_swap(&jobs[i].prod, ops[i].res);
+        bn_free(&jobs[i].prod);
+        bn_shrink(ops[i].res);
+    }
     return true;
 }
 
+bool bn_mult(bn_t *a, bn_t *res)
+{
+    struct bn_mul_op op = {a, res};
+    return bn_mul_many(&op, 1);
+}
+
+/* res = res^2 */
+bool bn_sqr(bn_t *res)
+{
+    struct bn_mul_op op = {NULL, res};
+    return bn_mul_many(&op, 1);
+}
+
+/* Inline limbs move along with the value, so num is pointed back to them */
 void bn_swap(bn_t *a, bn_t *b)
 {
-    swap(a->length, b->length);
-    swap(a->num, b->num);
+    bool a_inl = a->num == a->inl, b_inl = b->num == b->inl;
+
+    swap(*a, *b);
+    if (a_inl)
+        b->num = b->inl;
+    if (b_inl)
+        a->num = a->inl;
+}
+
+/* Each bn_tune timing repeats a squaring for at least this long */
+#define BN_TUNE_NS 50000
+#define BN_TUNE_ROUNDS 3
+
+/* Shortest time a square of n limbs takes over BN_TUNE_ROUNDS rounds */
+static u64 bn_tune_time(unsigned long long *r,
+                        const unsigned long long *a,
+                        unsigned long long n,
+                        unsigned long long *scratch,
+                        bool ntt)
+{
+    struct bn_mul_cut cut;
+    u64 best = U64_MAX;
+
+    bn_mul_cut_get(&cut);
+    for (int round = 0; round < BN_TUNE_ROUNDS; round++) {
+        unsigned long long reps;
+        u64 ns;
+        for (reps = 1;; reps *= 2) {
+            ktime_t kt = ktime_get();
+            for (unsigned long long i = 0; i < reps; i++) {
+                if (ntt)
+                    bn_mul_ntt(r, a, n, a, n, scratch, false);
+                else
+                    bn_sqr_limbs(r, a, n, scratch, &cut);
+            }
+            ns = ktime_to_ns(ktime_sub(ktime_get(), kt));
+            if (ns >= BN_TUNE_NS)
+                break;
+        }
+        best = min(best, div64_u64(ns, reps));
+    }
+    return best;
+}
+
+/*
+ * Smallest size from from up to to, in steps of 1/8, at which squaring
+ * with *threshold at the size beats squaring with it just above, and
+ * the next size agrees. The NTT threshold is not read by bn_sqr_limbs,
+ * so there the NTT runs against the other algorithms. 0 if none wins.
+ */
+static unsigned int bn_tune_crossover(unsigned int *threshold,
+                                      unsigned long long from,
+                                      unsigned long long to,
+                                      unsigned long long *buf)
+{
+    bool ntt = threshold == &bn_ntt_threshold;
+    unsigned long long *r = buf + to, *scratch = buf + 3 * to;
+    unsigned long long first = 0;
+
+    for (unsigned long long n = from; n <= to; n += max(n / 8, 4ULL)) {
+        *threshold = n + 1;
+        u64 slow = bn_tune_time(r, buf, n, scratch, false);
+        *threshold = n;
+        u64 fast = bn_tune_time(r, buf, n, scratch, ntt);
+
+        if (fast >= slow)
+            first = 0;
+        else if (first)
+            return first;
+        else
+            first = n;
+        cond_resched();
+    }
+    return 0;
+}
+
+/*
+ * Sets the Karatsuba, Toom-3 and NTT thresholds from where each starts to
+ * win on this machine, timing squares, which most of the engines' products
+ * are. A threshold that never wins in its range keeps its value. Must run
+ * before any product can, the thresholds change under it.
+ */
+void bn_tune(void)
+{
+    static const struct {
+        unsigned int *threshold;
+        unsigned long long from, to;
+    } tune[] = {
+        {&bn_karatsuba_threshold, 8, 128},
+        {&bn_toom3_threshold, 48, 1024},
+        {&bn_ntt_threshold, 512, 8192},
+    };
+    unsigned long long to = tune[ARRAY_SIZE(tune) - 1].to;
+    unsigned long long len =
+        3 * to + max(BN_MUL_SCRATCH(to), bn_ntt_scratch(2 * to, false));
+    unsigned long long *buf = kvmalloc_array(len, sizeof(*buf), GFP_KERNEL);
+    unsigned int toom3 = bn_toom3_threshold;
+
+    if (!buf)
+        return;
+    get_random_bytes(buf, sizeof(*buf) * to);
+    /* Karatsuba is timed against schoolbook alone */
+    bn_toom3_threshold = UINT_MAX;
+    for (int i = 0; i < ARRAY_SIZE(tune); i++) {
+        unsigned int old = i == 1 ? toom3 : *tune[i].threshold;
+        unsigned int n = bn_tune_crossover(tune[i].threshold, tune[i].from,
+                                           tune[i].to, buf);
+        *tune[i].threshold = n ? n : old;
+    }
+    kvfree(buf);
+}
+
+/* Limbs each kernel goes through per size in the kernels file */
+#define BN_BENCH_LIMBS (1ULL << 20)
+
+static const unsigned long long bn_bench_sizes[] = {8, 64, 1024};
+
+static const struct {
+    const char *name;
+    const char *impl;
+} bn_bench_kernels[] = {
+    {"add_n", "generic"},
+    {"sub_n", "generic"},
+    {"add_n_inplace", "generic"},
+    {"addmul_1", "generic"},
+#ifdef CONFIG_X86_64
+    {"add_n", "adc"},
+    {"sub_n", "sbb"},
+    {"add_n_inplace", "adc"},
+    {"addmul_1", "adx"},
+#endif
+};
+
+/* Runs kernel k of bn_bench_kernels once over n limbs */
+static void bn_bench_run(int k,
+                         unsigned long long *r,
+                         const unsigned long long *a,
+                         const unsigned long long *b,
+                         unsigned long long n)
+{
+    switch (k) {
+    case 0:
+        bn_add_nc_generic(r, a, b, n, 0);
+        break;
+    case 1:
+        bn_sub_nc_generic(r, a, b, n, 0);
+        break;
+    case 2:
+        bn_add_nc_generic(r, r, b, n, 0);
+        break;
+    case 3:
+        bn_addmul_1_generic(r, a, n, b[0]);
+        break;
+#ifdef CONFIG_X86_64
+    case 4:
+        bn_add_nc_x86(r, a, b, n, 0);
+        break;
+    case 5:
+        bn_sub_nc_x86(r, a, b, n, 0);
+        break;
+    case 6:
+        bn_add_nc_x86(r, r, b, n, 0);
+        break;
+    case 7:
+        bn_addmul_1_adx(r, a, n, b[0]);
+        break;
+#endif
+    }
+}
+
+/* Picoseconds per limb of every add and sub kernel, timed on reading */
+static int bn_kernels_show(struct seq_file *s, void *unused)
+{
+    unsigned long long max_n = bn_bench_sizes[ARRAY_SIZE(bn_bench_sizes) - 1];
+    unsigned long long *buf =
+        kvmalloc_array(3 * max_n, sizeof(*buf), GFP_KERNEL);
+
+    if (!buf)
+        return -ENOMEM;
+    get_random_bytes(buf, sizeof(*buf) * 3 * max_n);
+#ifdef CONFIG_X86_64
+    seq_printf(s, "# addmul_1 uses %s\n",
+               static_branch_likely(&bn_adx) ? "adx" : "generic");
+#endif
+    seq_puts(s, "# kernel impl limbs ps/limb\n");
+    for (int k = 0; k < ARRAY_SIZE(bn_bench_kernels); k++) {
+#ifdef CONFIG_X86_64
+        if (k == 7 && !static_branch_likely(&bn_adx))
+            continue;
+#endif
+        for (int j = 0; j < ARRAY_SIZE(bn_bench_sizes); j++) {
+            unsigned long long n = bn_bench_sizes[j];
+            unsigned long long reps = BN_BENCH_LIMBS / n;
+            ktime_t kt = ktime_get();
+
+            for (unsigned long long i = 0; i < reps; i++)
+                bn_bench_run(k, buf, buf + max_n, buf + 2 * max_n, n);
+            kt = ktime_sub(ktime_get(), kt);
+            seq_printf(s, "%s %s %llu %llu\n", bn_bench_kernels[k].name,
+                       bn_bench_kernels[k].impl, n,
+                       ktime_to_ns(kt) * 1000 / (reps * n));
+            cond_resched();
+        }
+    }
+    kvfree(buf);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(bn_kernels);
+
+void bn_debugfs(struct dentry *dir)
+{
+    debugfs_create_file("kernels", 0444, dir, NULL, &bn_kernels_fops);
 }
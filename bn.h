@@ -2,11 +2,63 @@
 #define _FIB_BN_H
 #include <linux/types.h>
 
+/* Limb counts above which bn_mult switches to Karatsuba / Toom-3 / NTT */
+#define BN_KARATSUBA_THRESHOLD 24
+#define BN_TOOM3_THRESHOLD 160
+#define BN_NTT_THRESHOLD 2048
+/* Limb count above which products are spread over CPUs, 0 disables it */
+#define BN_PARALLEL_THRESHOLD 4096
+
+extern unsigned int bn_karatsuba_threshold;
+extern unsigned int bn_toom3_threshold;
+extern unsigned int bn_ntt_threshold;
+extern unsigned int bn_parallel_threshold;
+
+/*
+ * A bn_arena is a pool of equally sized limb blocks plus one scratch area
+ * for multiplication, reserved upfront for a whole computation. Every bn_t
+ * pointing to an arena takes its storage from the pool and only falls back
+ * to the heap once a value outgrows a block or the pool runs out.
+ */
+struct bn_arena {
+    unsigned long long *pool;
+    unsigned long long block_len;
+    unsigned long long nblocks;
+    unsigned long long free_map;
+    unsigned long long *scratch;
+    unsigned long long scratch_len;
+    bool scratch_busy;
+    unsigned long long heap_allocs; /* heap allocations made */
+    unsigned long long heap_ns;     /* time spent in them */
+};
+
+#define BN_ARENA_MAX_BLOCKS 64
+
+/* Values up to this many limbs live in the bn_t itself */
+#define BN_INLINE_LIMBS 4
+
+/*
+ * length limbs of num are in use out of cap allocated ones, so a value
+ * shrinks and regrows without touching its storage. num points to inl
+ * while the value has no block of its own, so a bn_t must not be copied
+ * by assignment, only moved with bn_swap.
+ */
 typedef struct _bn {
     unsigned long long length;
+    unsigned long long cap;
     unsigned long long *num;
+    struct bn_arena *arena;
+    unsigned long long inl[BN_INLINE_LIMBS];
 } bn_t;
 
+bool bn_arena_reserve(struct bn_arena *arena,
+                      unsigned long long block_len,
+                      unsigned long long nblocks);
+
+void bn_arena_release(struct bn_arena *arena);
+
+unsigned long long bn_scratch_max(unsigned long long block_len);
+
 bool bn_new(bn_t *bn_ptr, unsigned long long length);
 
 bool bn_znew(bn_t *bn_ptr, unsigned long long length);
@@ -17,6 +69,12 @@ bool bn_zrenew(bn_t *bn_ptr, unsigned long long length);
 
 bool bn_extend(bn_t *bn_ptr, unsigned long long length);
 
+bool bn_renew(bn_t *bn_ptr, unsigned long long length);
+
+bool bn_copy(bn_t *dst, const bn_t *src);
+
+bool bn_shrink(bn_t *bn_ptr);
+
 bool bn_add(const bn_t *a, const bn_t *b, bn_t *res);
 
 bool bn_sub(const bn_t *a, const bn_t *b, bn_t *res);
@@ -27,6 +85,10 @@ bool bn_move(const bn_t *a, bn_t *res);
 
 void bn_add_carry(const bn_t *b, bn_t *res, int carry);
 
+bool bn_add_u64(bn_t *res, unsigned long long v);
+
+void bn_sub_u64(bn_t *res, unsigned long long v);
+
 bool bn_lshift(bn_t *res, unsigned long long bits);
 
 void bn_rshift(bn_t *res, unsigned long long bits);
@@ -37,4 +99,35 @@ void bn_swap(bn_t *a, bn_t *b);
 
 bool bn_mult(bn_t *a, bn_t *res);
 
+bool bn_sqr(bn_t *res);
+
+/* Most products bn_mul_many takes at once */
+#define BN_MUL_MAX 4
+
+/*
+ * One product of bn_mul_many: res = a * res, or res = res^2 if a is NULL.
+ * All operands are read before any res is written, so a res may be the
+ * operand of another product, but no two products may share a res.
+ */
+struct bn_mul_op {
+    bn_t *a;
+    bn_t *res;
+};
+
+bool bn_mul_many(struct bn_mul_op *ops, int n);
+
+/* Picks the add and multiply kernels for the CPU, once at load */
+void bn_cpu_init(void);
+
+/* Times the multiplication algorithms to set their thresholds */
+void bn_tune(void);
+
+struct dentry;
+
+void bn_debugfs(struct dentry *dir);
+
+void bn_workqueue_init(const char *name);
+
+void bn_workqueue_exit(void);
+
 #endif /* _FIB_BN_H */
\ No newline at end of file
@@ -0,0 +1,308 @@
+#include <linux/minmax.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+
+#include "bn_dec.h"
+
+/* 10^19, the largest power of ten in a limb, and its 2/1 reciprocal */
+#define BN_DEC_BASE 0x8ac7230489e80000ULL
+#define BN_DEC_BASE_INV 0xd83c94fb6d2ac34aULL
+#define BN_DEC_DIGITS 19
+
+/* Values up to this many limbs are converted by repeated division */
+#define BN_DEC_BASECASE 32
+
+#define BN_DEC_LEVELS 60
+
+/*
+ * bn_dec_pow[j] = 10^(19 * 2^j) and bn_dec_inv[j] = 2^(128 * 2^j) /
+ * bn_dec_pow[j], rounded down. Levels are only ever added, so a converter
+ * reads the first bn_dec_levels of them unlocked once it has seen the
+ * count under the lock.
+ */
+static bn_t bn_dec_pow[BN_DEC_LEVELS], bn_dec_inv[BN_DEC_LEVELS];
+static int bn_dec_levels;
+static DEFINE_MUTEX(bn_dec_lock);
+
+/* (u1:u0) / 10^19 for u1 < 10^19, by Moller and Granlund's 2/1 division */
+static unsigned long long bn_dec_div_2by1(unsigned long long u1,
+                                          unsigned long long u0,
+                                          unsigned long long *r)
+{
+    unsigned __int128 q = (unsigned __int128) BN_DEC_BASE_INV * u1 +
+                          ((unsigned __int128) u1 << 64 | u0);
+    unsigned long long q1 = (q >> 64) + 1, q0 = q;
+    unsigned long long rem = u0 - q1 * BN_DEC_BASE;
+
+    if (rem > q0) {
+        q1--;
+        rem += BN_DEC_BASE;
+    }
+    if (rem >= BN_DEC_BASE) {
+        q1++;
+        rem -= BN_DEC_BASE;
+    }
+    *r = rem;
+    return q1;
+}
+
+static unsigned long long bn_dec_top(const bn_t *a)
+{
+    unsigned long long n = a->length;
+    while (n > 1 && !a->num[n - 1])
+        n--;
+    return n;
+}
+
+static int bn_dec_cmp(const bn_t *a, const bn_t *b)
+{
+    unsigned long long n = bn_dec_top(a), m = bn_dec_top(b);
+    if (n != m)
+        return n < m ? -1 : 1;
+    while (n--) {
+        if (a->num[n] != b->num[n])
+            return a->num[n] < b->num[n] ? -1 : 1;
+    }
+    return 0;
+}
+
+/* a >>= bits, down to 0 once nothing is left */
+static void bn_dec_rshift(bn_t *a, unsigned long long bits)
+{
+    if (bn_dec_top(a) * 64 <= bits) {
+        memset(a->num, 0, sizeof(unsigned long long) * a->length);
+        a->length = 1;
+        return;
+    }
+    bn_rshift(a, bits);
+}
+
+/* Adds level j = bn_dec_levels, caller holds bn_dec_lock */
+static bool bn_dec_grow(void)
+{
+    int j = bn_dec_levels;
+    bn_t *p = &bn_dec_pow[j], *y = &bn_dec_inv[j];
+    bn_t t = {}, u = {};
+    bool err = false;
+
+    if (!j) {
+        err |= !bn_new(p, 1) || !bn_new(y, 2);
+        if (!err) {
+            p->num[0] = BN_DEC_BASE;
+            y->num[0] = BN_DEC_BASE_INV;
+            y->num[1] = 1;
+            bn_dec_levels++;
+        }
+        return !err;
+    }
+
+    /*
+     * inv[j - 1]^2 is short of 2^s / pow[j] by a relative error of about
+     * pow[j - 1] / 2^(s / 2), one Newton step y = 2y - pow[j] y^2 / 2^s
+     * squares that, and what rounding leaves is corrected by steps of one.
+     */
+    unsigned long long s = 128ULL << j;
+    err |= !bn_copy(p, &bn_dec_pow[j - 1]) || !bn_sqr(p);
+    err |= !bn_copy(y, &bn_dec_inv[j - 1]) || !bn_sqr(y);
+    err |= !bn_copy(&t, y) || !bn_sqr(&t) || !bn_mult(p, &t);
+    if (!err) {
+        bn_dec_rshift(&t, s);
+        err |= !bn_lshift(y, 1) || !bn_sub(y, &t, &u);
+        bn_swap(y, &u);
+    }
+
+    /* t = 2^s, u = pow[j] y, then y += (t - u) / pow[j] one at a time */
+    err |= !bn_zrenew(&t, s / 64 + 1) || !bn_copy(&u, p) ||
+           !bn_mult(y, &u);
+    if (!err)
+        t.num[s / 64] = 1;
+    while (!err && bn_dec_cmp(&u, &t) > 0) {
+        bn_sub_u64(y, 1);
+        bn_t v = {};
+        err |= !bn_sub(&u, p, &v);
+        bn_swap(&u, &v);
+        bn_free(&v);
+    }
+    if (!err) {
+        bn_t v = {};
+        err |= !bn_sub(&t, &u, &v);  // v = 2^s - pow[j] y
+        while (!err && bn_dec_cmp(&v, p) >= 0) {
+            err |= !bn_add_u64(y, 1);
+            err |= !bn_sub(&v, p, &u);
+            bn_swap(&u, &v);
+        }
+        bn_free(&v);
+    }
+    bn_free(&t);
+    bn_free(&u);
+    if (err) {
+        bn_free(p);
+        bn_free(y);
+        return false;
+    }
+    bn_shrink(p);
+    bn_shrink(y);
+    bn_dec_levels++;
+    return true;
+}
+
+/* Makes levels 0..j available */
+static bool bn_dec_powers(int j)
+{
+    bool ok = true;
+
+    mutex_lock(&bn_dec_lock);
+    while (ok && bn_dec_levels <= j)
+        ok = bn_dec_grow();
+    mutex_unlock(&bn_dec_lock);
+    return ok;
+}
+
+/*
+ * q = x / pow[j], r = x % pow[j] for x < pow[j]^2, with q estimated as
+ * x inv[j] / 2^s, which is at most one short before the rounding of the
+ * reciprocal and the product
+ */
+static bool bn_dec_divmod(bn_t *x, int j, bn_t *q, bn_t *r)
+{
+    const bn_t *p = &bn_dec_pow[j];
+    bn_t t = {};
+    bool err = !bn_copy(q, &bn_dec_inv[j]) || !bn_mult(x, q);
+
+    if (!err)
+        bn_dec_rshift(q, 128ULL << j);
+    err = err || !bn_copy(&t, p) || !bn_mult(q, &t);
+    err = err || !bn_sub(x, &t, r);
+    while (!err && bn_dec_cmp(r, p) >= 0) {
+        err |= !bn_sub(r, p, &t);
+        bn_swap(r, &t);
+        err |= !bn_add_u64(q, 1);
+    }
+    bn_free(&t);
+    return !err;
+}
+
+/* Writes the c base 10^19 digits of x < 10^(19 * c), x is clobbered */
+static void bn_dec_basecase(bn_t *x,
+                            unsigned long long c,
+                            unsigned long long *out)
+{
+    unsigned long long n = bn_dec_top(x);
+
+    for (unsigned long long *end = out + c; end > out;) {
+        unsigned long long rem = 0;
+        for (unsigned long long i = n; i-- > 0;)
+            x->num[i] = bn_dec_div_2by1(rem, x->num[i], &rem);
+        while (n > 1 && !x->num[n - 1])
+            n--;
+        *--end = rem;
+        if (n == 1 && !x->num[0]) {
+            memset(out, 0, sizeof(unsigned long long) * (end - out));
+            break;
+        }
+    }
+}
+
+/*
+ * Writes the c base 10^19 digits of x < 10^(19 * c): split by the largest
+ * 10^(19 * 2^j) with 2^j < c, so both halves are again below their
+ * powers. x is clobbered.
+ */
+static bool bn_dec_put(bn_t *x, unsigned long long c, unsigned long long *out)
+{
+    if (bn_dec_top(x) <= BN_DEC_BASECASE) {
+        bn_dec_basecase(x, c, out);
+        return true;
+    }
+
+    int j = 63 - __builtin_clzll(c - 1);
+    unsigned long long h = 1ULL << j;
+    bn_t q = {}, r = {};
+    bool ok = bn_dec_divmod(x, j, &q, &r);
+
+    bn_free(x);
+    ok = ok && bn_dec_put(&q, c - h, out);
+    ok = ok && bn_dec_put(&r, h, out + c - h);
+    bn_free(&q);
+    bn_free(&r);
+    return ok;
+}
+
+/*
+ * The length limbs at num in base 10^19, most significant digit first,
+ * in count limbs to release with kvfree. Returns NULL if memory runs out.
+ */
+unsigned long long *bn_dec19(const unsigned long long *num,
+                             unsigned long long length,
+                             size_t *count)
+{
+    /* 10^19 > 2^63.1, so 64 bits need a little over one digit */
+    unsigned long long c = length + length / 64 + 1;
+    unsigned long long *out = kvmalloc_array(c, sizeof(*out), GFP_KERNEL);
+    bn_t x = {};
+    bool ok = out && bn_new(&x, length);
+
+    if (ok && length > BN_DEC_BASECASE)
+        ok = bn_dec_powers(63 - __builtin_clzll(c - 1));
+    if (ok) {
+        memcpy(x.num, num, sizeof(unsigned long long) * length);
+        ok = bn_dec_put(&x, c, out);
+    }
+    bn_free(&x);
+    if (!ok) {
+        kvfree(out);
+        return NULL;
+    }
+    size_t skip = 0;
+    while (skip < c - 1 && !out[skip])
+        skip++;
+    memmove(out, out + skip, sizeof(*out) * (c - skip));
+    *count = c - skip;
+    return out;
+}
+
+/*
+ * Decimal digits of the length limbs at num, most significant first and
+ * without a terminator, in a buffer to release with kvfree. Returns NULL
+ * if memory runs out.
+ */
+char *bn_dec(const unsigned long long *num,
+             unsigned long long length,
+             size_t *size)
+{
+    size_t count;
+    unsigned long long *dec = bn_dec19(num, length, &count);
+    char *out = dec ? kvmalloc(BN_DEC_DIGITS * count, GFP_KERNEL) : NULL;
+
+    if (!out) {
+        kvfree(dec);
+        return NULL;
+    }
+    char *end = out + BN_DEC_DIGITS * count;
+    for (size_t i = count; i-- > 0;) {
+        for (int d = 0; d < BN_DEC_DIGITS; d++) {
+            *--end = '0' + dec[i] % 10;
+            dec[i] /= 10;
+        }
+    }
+    kvfree(dec);
+
+    size_t skip = 0;
+    while (skip < BN_DEC_DIGITS - 1 && out[skip] == '0')
+        skip++;
+    *size = BN_DEC_DIGITS * count - skip;
+    memmove(out, out + skip, *size);
+    return out;
+}
+
+void bn_dec_clear(void)
+{
+    mutex_lock(&bn_dec_lock);
+    while (bn_dec_levels) {
+        bn_dec_levels--;
+        bn_free(&bn_dec_pow[bn_dec_levels]);
+        bn_free(&bn_dec_inv[bn_dec_levels]);
+    }
+    mutex_unlock(&bn_dec_lock);
+}
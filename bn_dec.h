@@ -0,0 +1,17 @@
+#ifndef _FIB_BN_DEC_H
+#define _FIB_BN_DEC_H
+#include <linux/types.h>
+
+#include "bn.h"
+
+unsigned long long *bn_dec19(const unsigned long long *num,
+                             unsigned long long length,
+                             size_t *count);
+
+char *bn_dec(const unsigned long long *num,
+             unsigned long long length,
+             size_t *size);
+
+void bn_dec_clear(void);
+
+#endif /* _FIB_BN_DEC_H */
@@ -0,0 +1,168 @@
+#include <linux/debugfs.h>
+#include <linux/hashtable.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/rcupdate.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+#include "fib_cache.h"
+
+#define FIB_CACHE_BITS 6
+
+unsigned int fib_cache_size = FIB_CACHE_SIZE;
+
+/*
+ * Lookups walk the table under RCU and only mark the entry they take as
+ * used, so readers on different CPUs do not serialize on a lock. Inserts
+ * and eviction hold fib_cache_lock: new entries go to the head of the LRU
+ * list and eviction takes the tail, moving a used one back to the head
+ * once instead, an approximation of LRU order known as CLOCK.
+ */
+static DEFINE_HASHTABLE(fib_cache_table, FIB_CACHE_BITS);
+static LIST_HEAD(fib_cache_lru);
+static DEFINE_MUTEX(fib_cache_lock);
+static unsigned long long fib_cache_bytes, fib_cache_entries;
+static unsigned long long fib_cache_evictions;
+static DEFINE_PER_CPU(unsigned long long, fib_cache_hits);
+static DEFINE_PER_CPU(unsigned long long, fib_cache_misses);
+
+static size_t fib_cache_entry_size(unsigned long long length)
+{
+    return sizeof(struct fib_cache_entry) + sizeof(unsigned long long) * length;
+}
+
+/* A lookup may still be looking at the entry, it goes after a grace period */
+static void fib_cache_release(struct kref *ref)
+{
+    struct fib_cache_entry *entry =
+        container_of(ref, struct fib_cache_entry, ref);
+    kvfree_rcu(entry, rcu);
+}
+
+void fib_cache_put(struct fib_cache_entry *entry)
+{
+    kref_put(&entry->ref, fib_cache_release);
+}
+
+/* Drop least recently used entries until at most budget bytes are held */
+static void fib_cache_evict(unsigned long long budget)
+{
+    while (fib_cache_bytes > budget) {
+        struct fib_cache_entry *entry =
+            list_last_entry(&fib_cache_lru, struct fib_cache_entry, lru);
+        if (READ_ONCE(entry->used)) {
+            WRITE_ONCE(entry->used, false);
+            list_move(&entry->lru, &fib_cache_lru);
+            continue;
+        }
+        hash_del_rcu(&entry->node);
+        list_del(&entry->lru);
+        fib_cache_bytes -= fib_cache_entry_size(entry->length);
+        fib_cache_entries--;
+        fib_cache_evictions++;
+        fib_cache_put(entry);
+    }
+}
+
+/* Returns a referenced entry for F(k), release it with fib_cache_put */
+struct fib_cache_entry *fib_cache_lookup(long long k)
+{
+    unsigned long long budget = (unsigned long long) fib_cache_size << 10;
+    struct fib_cache_entry *entry;
+
+    /* trims the cache after the budget was lowered */
+    if (READ_ONCE(fib_cache_bytes) > budget) {
+        mutex_lock(&fib_cache_lock);
+        fib_cache_evict(budget);
+        mutex_unlock(&fib_cache_lock);
+    }
+    if (!budget)
+        return NULL;
+
+    rcu_read_lock();
+    hash_for_each_possible_rcu(fib_cache_table, entry, node, k) {
+        /* a zero count is an entry on its way out */
+        if (entry->k == k && kref_get_unless_zero(&entry->ref)) {
+            if (!READ_ONCE(entry->used))
+                WRITE_ONCE(entry->used, true);
+            rcu_read_unlock();
+            this_cpu_inc(fib_cache_hits);
+            return entry;
+        }
+    }
+    rcu_read_unlock();
+    this_cpu_inc(fib_cache_misses);
+    return NULL;
+}
+
+/* Store a copy of F(k), evicting older entries to stay within the budget */
+void fib_cache_insert(long long k,
+                      const unsigned long long *num,
+                      unsigned long long length)
+{
+    unsigned long long budget = (unsigned long long) fib_cache_size << 10;
+    size_t size = fib_cache_entry_size(length);
+    struct fib_cache_entry *entry, *old;
+
+    if (size > budget)
+        return;
+    entry = kvmalloc(size, GFP_KERNEL);
+    if (!entry)
+        return;
+    kref_init(&entry->ref);
+    entry->used = false;
+    entry->k = k;
+    entry->length = length;
+    memcpy(entry->num, num, sizeof(unsigned long long) * length);
+
+    mutex_lock(&fib_cache_lock);
+    /* another reader may have inserted F(k) meanwhile */
+    hash_for_each_possible(fib_cache_table, old, node, k) {
+        if (old->k == k) {
+            mutex_unlock(&fib_cache_lock);
+            kvfree(entry);
+            return;
+        }
+    }
+    fib_cache_evict(budget - size);
+    hash_add_rcu(fib_cache_table, &entry->node, k);
+    list_add(&entry->lru, &fib_cache_lru);
+    fib_cache_bytes += size;
+    fib_cache_entries++;
+    mutex_unlock(&fib_cache_lock);
+}
+
+void fib_cache_clear(void)
+{
+    mutex_lock(&fib_cache_lock);
+    fib_cache_evict(0);
+    mutex_unlock(&fib_cache_lock);
+}
+
+static int fib_cache_show(struct seq_file *s, void *unused)
+{
+    unsigned long long hits = 0, misses = 0;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        hits += per_cpu(fib_cache_hits, cpu);
+        misses += per_cpu(fib_cache_misses, cpu);
+    }
+    mutex_lock(&fib_cache_lock);
+    seq_printf(s, "hits %llu\n", hits);
+    seq_printf(s, "misses %llu\n", misses);
+    seq_printf(s, "evictions %llu\n", fib_cache_evictions);
+    seq_printf(s, "entries %llu\n", fib_cache_entries);
+    seq_printf(s, "bytes %llu\n", fib_cache_bytes);
+    seq_printf(s, "budget %llu\n", (unsigned long long) fib_cache_size << 10);
+    mutex_unlock(&fib_cache_lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(fib_cache);
+
+void fib_cache_debugfs(struct dentry *dir)
+{
+    debugfs_create_file("cache", 0444, dir, NULL, &fib_cache_fops);
+}
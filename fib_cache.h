@@ -0,0 +1,43 @@
+#ifndef _FIB_CACHE_H
+#define _FIB_CACHE_H
+#include <linux/kref.h>
+#include <linux/list.h>
+#include <linux/rcupdate.h>
+#include <linux/types.h>
+
+/* Memory the cache may hold, in KiB. 0 disables caching */
+#define FIB_CACHE_SIZE 4096
+
+extern unsigned int fib_cache_size;
+
+/*
+ * A finished F(k). Entries are reference counted, so a reader can copy
+ * one out while eviction drops it, and freed after an RCU grace period,
+ * as lookups hold no lock.
+ */
+struct fib_cache_entry {
+    struct hlist_node node;
+    struct list_head lru;
+    struct kref ref;
+    struct rcu_head rcu;
+    bool used; /* looked up since eviction last passed it */
+    long long k;
+    unsigned long long length;
+    unsigned long long num[];
+};
+
+struct dentry;
+
+struct fib_cache_entry *fib_cache_lookup(long long k);
+
+void fib_cache_insert(long long k,
+                      const unsigned long long *num,
+                      unsigned long long length);
+
+void fib_cache_put(struct fib_cache_entry *entry);
+
+void fib_cache_clear(void);
+
+void fib_cache_debugfs(struct dentry *dir);
+
+#endif /* _FIB_CACHE_H */
@@ -0,0 +1,207 @@
+#include <linux/debugfs.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+#include "fib_checkpoint.h"
+
+/*
+ * A checkpoint at m only pays off for k close above it: seeding costs
+ * F(k - m) plus two to four products the size of F(m), which breaks even
+ * with starting over at about k - m = k / 5.
+ */
+#define FIB_CHECKPOINT_REACH 8
+
+unsigned int fib_checkpoint_gap = FIB_CHECKPOINT_GAP;
+unsigned int fib_checkpoint_size = FIB_CHECKPOINT_SIZE;
+
+/* Ordered by m for the floor search, plus an LRU list for eviction */
+static struct rb_root fib_checkpoints = RB_ROOT;
+static LIST_HEAD(fib_checkpoint_lru);
+static DEFINE_MUTEX(fib_checkpoint_lock);
+static unsigned long long fib_checkpoint_bytes, fib_checkpoint_entries;
+static unsigned long long fib_checkpoint_hits, fib_checkpoint_misses;
+static unsigned long long fib_checkpoint_evictions;
+
+static size_t fib_checkpoint_bytes_of(unsigned long long length)
+{
+    return sizeof(struct fib_checkpoint) + sizeof(unsigned long long) * length;
+}
+
+static void fib_checkpoint_release(struct kref *ref)
+{
+    kvfree(container_of(ref, struct fib_checkpoint, ref));
+}
+
+void fib_checkpoint_put(struct fib_checkpoint *cp)
+{
+    kref_put(&cp->ref, fib_checkpoint_release);
+}
+
+/* Greatest checkpoint at or below k, caller holds fib_checkpoint_lock */
+static struct fib_checkpoint *fib_checkpoint_floor(long long k)
+{
+    struct rb_node *node = fib_checkpoints.rb_node;
+    struct fib_checkpoint *floor = NULL;
+
+    while (node) {
+        struct fib_checkpoint *cp =
+            rb_entry(node, struct fib_checkpoint, node);
+        if (cp->m <= k) {
+            floor = cp;
+            node = node->rb_right;
+        } else {
+            node = node->rb_left;
+        }
+    }
+    return floor;
+}
+
+/* Whether another checkpoint lies closer than the gap to m, locked */
+static bool fib_checkpoint_crowded(long long m, unsigned int gap)
+{
+    struct fib_checkpoint *cp = fib_checkpoint_floor(m + gap - 1);
+    return cp && cp->m > m - gap;
+}
+
+static void fib_checkpoint_evict(unsigned long long budget)
+{
+    while (fib_checkpoint_bytes > budget) {
+        struct fib_checkpoint *cp = list_last_entry(
+            &fib_checkpoint_lru, struct fib_checkpoint, lru);
+        rb_erase(&cp->node, &fib_checkpoints);
+        list_del(&cp->lru);
+        fib_checkpoint_bytes -=
+            fib_checkpoint_bytes_of(cp->len[0] + cp->len[1]);
+        fib_checkpoint_entries--;
+        fib_checkpoint_evictions++;
+        fib_checkpoint_put(cp);
+    }
+}
+
+/*
+ * Returns a referenced checkpoint close enough below k to seed F(k) from,
+ * release it with fib_checkpoint_put.
+ */
+struct fib_checkpoint *fib_checkpoint_find(long long k)
+{
+    unsigned long long budget = (unsigned long long) fib_checkpoint_size << 10;
+    unsigned int gap = fib_checkpoint_gap;
+    struct fib_checkpoint *cp;
+
+    mutex_lock(&fib_checkpoint_lock);
+    /* trims the table after the budget was lowered or the gap set to 0 */
+    fib_checkpoint_evict(gap ? budget : 0);
+    if (!gap) {
+        mutex_unlock(&fib_checkpoint_lock);
+        return NULL;
+    }
+    cp = fib_checkpoint_floor(k);
+    if (cp && k - cp->m <= k / FIB_CHECKPOINT_REACH) {
+        list_move(&cp->lru, &fib_checkpoint_lru);
+        kref_get(&cp->ref);
+        fib_checkpoint_hits++;
+    } else {
+        cp = NULL;
+        fib_checkpoint_misses++;
+    }
+    mutex_unlock(&fib_checkpoint_lock);
+    return cp;
+}
+
+/* Whether a checkpoint at m would respect the configured density */
+bool fib_checkpoint_wanted(long long m)
+{
+    unsigned int gap = fib_checkpoint_gap;
+    bool wanted;
+
+    if (!gap)
+        return false;
+    mutex_lock(&fib_checkpoint_lock);
+    wanted = !fib_checkpoint_crowded(m, gap);
+    mutex_unlock(&fib_checkpoint_lock);
+    return wanted;
+}
+
+/* Store the pair (F(m), F(m + 1)), both without leading zero limbs */
+void fib_checkpoint_add(long long m, const bn_t *fm, const bn_t *fm1)
+{
+    unsigned long long budget = (unsigned long long) fib_checkpoint_size << 10;
+    size_t size = fib_checkpoint_bytes_of(fm->length + fm1->length);
+    unsigned int gap = fib_checkpoint_gap;
+    struct rb_node **link = &fib_checkpoints.rb_node, *parent = NULL;
+    struct fib_checkpoint *cp;
+
+    if (!gap || size > budget)
+        return;
+    cp = kvmalloc(size, GFP_KERNEL);
+    if (!cp)
+        return;
+    kref_init(&cp->ref);
+    cp->m = m;
+    cp->len[0] = fm->length;
+    cp->len[1] = fm1->length;
+    memcpy(cp->num, fm->num, sizeof(unsigned long long) * fm->length);
+    memcpy(cp->num + fm->length, fm1->num,
+           sizeof(unsigned long long) * fm1->length);
+
+    mutex_lock(&fib_checkpoint_lock);
+    if (fib_checkpoint_crowded(m, gap)) {
+        mutex_unlock(&fib_checkpoint_lock);
+        kvfree(cp);
+        return;
+    }
+    fib_checkpoint_evict(budget - size);
+    while (*link) {
+        parent = *link;
+        if (m < rb_entry(parent, struct fib_checkpoint, node)->m)
+            link = &parent->rb_left;
+        else
+            link = &parent->rb_right;
+    }
+    rb_link_node(&cp->node, parent, link);
+    rb_insert_color(&cp->node, &fib_checkpoints);
+    list_add(&cp->lru, &fib_checkpoint_lru);
+    fib_checkpoint_bytes += size;
+    fib_checkpoint_entries++;
+    mutex_unlock(&fib_checkpoint_lock);
+}
+
+/* res = F(m + i), i is 0 or 1 */
+bool fib_checkpoint_load(const struct fib_checkpoint *cp, int i, bn_t *res)
+{
+    if (!bn_renew(res, cp->len[i]))
+        return false;
+    memcpy(res->num, cp->num + (i ? cp->len[0] : 0),
+           sizeof(unsigned long long) * cp->len[i]);
+    return true;
+}
+
+void fib_checkpoint_clear(void)
+{
+    mutex_lock(&fib_checkpoint_lock);
+    fib_checkpoint_evict(0);
+    mutex_unlock(&fib_checkpoint_lock);
+}
+
+static int fib_checkpoint_show(struct seq_file *s, void *unused)
+{
+    mutex_lock(&fib_checkpoint_lock);
+    seq_printf(s, "hits %llu\n", fib_checkpoint_hits);
+    seq_printf(s, "misses %llu\n", fib_checkpoint_misses);
+    seq_printf(s, "evictions %llu\n", fib_checkpoint_evictions);
+    seq_printf(s, "entries %llu\n", fib_checkpoint_entries);
+    seq_printf(s, "bytes %llu\n", fib_checkpoint_bytes);
+    seq_printf(s, "budget %llu\n",
+               (unsigned long long) fib_checkpoint_size << 10);
+    seq_printf(s, "gap %u\n", fib_checkpoint_gap);
+    mutex_unlock(&fib_checkpoint_lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(fib_checkpoint);
+
+void fib_checkpoint_debugfs(struct dentry *dir)
+{
+    debugfs_create_file("checkpoints", 0444, dir, NULL, &fib_checkpoint_fops);
+}
@@ -0,0 +1,47 @@
+#ifndef _FIB_CHECKPOINT_H
+#define _FIB_CHECKPOINT_H
+#include <linux/kref.h>
+#include <linux/list.h>
+#include <linux/rbtree.h>
+#include <linux/types.h>
+
+#include "bn.h"
+
+/* Minimum distance between two checkpoints, 0 disables checkpointing */
+#define FIB_CHECKPOINT_GAP 1024
+/* Memory the checkpoints may hold, in KiB */
+#define FIB_CHECKPOINT_SIZE 8192
+
+extern unsigned int fib_checkpoint_gap;
+extern unsigned int fib_checkpoint_size;
+
+/*
+ * The pair (F(m), F(m + 1)), stored back to back in num. Checkpoints are
+ * reference counted like cache entries, so they can be read unlocked.
+ */
+struct fib_checkpoint {
+    struct rb_node node;
+    struct list_head lru;
+    struct kref ref;
+    long long m;
+    unsigned long long len[2];
+    unsigned long long num[];
+};
+
+struct dentry;
+
+struct fib_checkpoint *fib_checkpoint_find(long long k);
+
+bool fib_checkpoint_wanted(long long m);
+
+void fib_checkpoint_add(long long m, const bn_t *fm, const bn_t *fm1);
+
+bool fib_checkpoint_load(const struct fib_checkpoint *cp, int i, bn_t *res);
+
+void fib_checkpoint_put(struct fib_checkpoint *cp);
+
+void fib_checkpoint_clear(void);
+
+void fib_checkpoint_debugfs(struct dentry *dir);
+
+#endif /* _FIB_CHECKPOINT_H */
@@ -0,0 +1,173 @@
+#include "fib_engine.h"
+
+/* F(0) or F(1), and F(1) = F(2) = 1 after it */
+static unsigned long long fib_first(long long k, bn_t *ret, bn_t *next)
+{
+    if (!bn_new(ret, 1))
+        return 0;
+    ret->num[0] = k;
+    if (next) {
+        if (!bn_new(next, 1)) {
+            bn_free(ret);
+            return 0;
+        }
+        next->num[0] = 1;
+    }
+    return 1;
+}
+
+unsigned long long fib_sequence(long long k, bn_t *ret, bn_t *next)
+{
+    /* FIXME: use clz/ctz and fast algorithms to speed up */
+    if (k == 0 || k == 1)
+        return fib_first(k, ret, next);
+
+    bn_t a = {.arena = ret->arena}, b = {.arena = ret->arena};
+    bn_t res = {.arena = ret->arena};
+    bn_znew(&a, 1);
+    bn_znew(&b, 1);
+
+    if (!a.num || !b.num) {
+        bn_free(&a);
+        bn_free(&b);
+        return 0;
+    }
+    a.num[0] = 0;
+    b.num[0] = 1;
+    bool err = false;
+    for (long long i = 2; i <= k; i++) {
+        if (!bn_add(&a, &b, &res)) {
+            err = true;
+            break;
+        }
+        bn_swap(&a, &b);
+        bn_swap(&b, &res);
+    }
+    if (next && !err)
+        err = !bn_add(&a, &b, next);  // next = F(k-1) + F(k)
+    bn_free(&a);
+    bn_free(&res);
+    bn_swap(ret, &b);
+    if (err) {
+        bn_free(ret);
+        return 0;
+    }
+    return ret->length;
+}
+unsigned long long fib_doubling(long long k, bn_t *ret, bn_t *next)
+{
+    if (k == 0 || k == 1)
+        return fib_first(k, ret, next);
+
+    bn_t a = {.arena = ret->arena}, b = {.arena = ret->arena};
+    bn_znew(&a, 2);
+    bn_znew(&b, 2);
+    int bits = 64 - __builtin_clzll(k);
+    if (!a.num || !b.num) {
+        bn_free(&a);
+        bn_free(&b);
+        return 0;
+    }
+    a.num[0] = 0;
+    b.num[0] = 1;
+    bool err = false;
+    for (int i = bits - 1; i >= 0; i--) {
+        bn_t t1 = {.arena = ret->arena}, t2 = {.arena = ret->arena};
+        err |= !bn_add(&b, &b, &t1);   // t1 = 2*b
+        err |= !bn_sub(&t1, &a, &t2);  // t2 = 2*b - a
+        bn_free(&t1);
+
+        /* t2 = a*(2*b - a), a = a^2, b = b^2, possibly on several CPUs */
+        struct bn_mul_op ops[] = {{&a, &t2}, {NULL, &a}, {NULL, &b}};
+        err |= !bn_mul_many(ops, 3);
+        err |= !bn_add(&a, &b, &t1);  // t1 = a^2 + b^2
+        bn_swap(&a, &t2);
+        bn_swap(&b, &t1);
+
+        if (k & 1ULL << i) {
+            err |= !bn_add(&a, &b, &t1);  // t1 = a+b
+            bn_swap(&a, &b);              // a = b
+            bn_swap(&b, &t1);             // b = t1
+        }
+
+        bn_free(&t1);
+        bn_free(&t2);
+        if (err)
+            break;
+    }
+    bn_swap(&a, ret);
+    if (next && !err) {
+        bn_shrink(&b);
+        bn_swap(&b, next);  // b = F(k+1) already
+    }
+    bn_free(&a);
+    bn_free(&b);
+    if (err) {
+        bn_free(ret);
+        return 0;
+    }
+    return ret->length;
+}
+
+/*
+ * Fast doubling with two squarings per bit. Keeps (F(n), F(n-1)) and uses
+ *   F(2n+1) = 4F(n)^2 - F(n-1)^2 + 2(-1)^n
+ *   F(2n-1) = F(n)^2 + F(n-1)^2
+ *   F(2n)   = F(2n+1) - F(2n-1)
+ * which avoids the general multiplication of fib_doubling.
+ * Leaves F(k) in a and F(k-1) in b, F(-1) = 1. The caller frees both.
+ */
+bool fib_lucas_pair(long long k, bn_t *a, bn_t *b)
+{
+    if (!bn_znew(a, 1) || !bn_znew(b, 1))
+        return false;
+    a->num[0] = k != 0;  // F(1) or F(0)
+    b->num[0] = k == 0;  // F(0) or F(-1)
+    int bits = k ? 64 - __builtin_clzll(k) : 1;
+    bool odd = true, err = false;
+    for (int i = bits - 2; i >= 0; i--) {
+        bn_t t = {.arena = a->arena}, u = {.arena = a->arena};
+        struct bn_mul_op sq[] = {{NULL, a}, {NULL, b}};
+        err |= !bn_mul_many(sq, 2);
+        err |= !bn_add(a, b, &t);  // t = F(2n-1)
+        err |= !bn_lshift(a, 2);
+        err |= !bn_sub(a, b, &u);  // u = 4F(n)^2 - F(n-1)^2
+        if (odd)
+            bn_sub_u64(&u, 2);
+        else
+            err |= !bn_add_u64(&u, 2);  // u = F(2n+1)
+
+        odd = k & 1ULL << i;
+        if (odd) {
+            err |= !bn_sub(&u, &t, b);  // b = F(2n)
+            bn_swap(a, &u);             // a = F(2n+1)
+        } else {
+            err |= !bn_sub(&u, &t, a);  // a = F(2n)
+            bn_swap(b, &t);             // b = F(2n-1)
+        }
+
+        bn_free(&t);
+        bn_free(&u);
+        if (err)
+            break;
+    }
+    return !err;
+}
+
+unsigned long long fib_lucas(long long k, bn_t *ret, bn_t *next)
+{
+    bn_t a = {.arena = ret->arena}, b = {.arena = ret->arena};
+    bool ok = fib_lucas_pair(k, &a, &b);
+
+    if (next && ok)
+        ok = bn_add(&a, &b, next);  // next = F(k) + F(k-1)
+    bn_free(&b);
+    if (!ok) {
+        bn_free(&a);
+        return 0;
+    }
+    bn_shrink(&a);
+    bn_swap(&a, ret);
+    bn_free(&a);
+    return ret->length;
+}
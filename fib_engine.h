@@ -0,0 +1,22 @@
+#ifndef _FIB_ENGINE_H
+#define _FIB_ENGINE_H
+#include <linux/types.h>
+
+#include "bn.h"
+
+/*
+ * Ways to compute ret = F(k), returning its limb count or 0 if memory ran
+ * out. next, if not NULL, also gets F(k + 1), which each of them has at
+ * hand or one addition away. They only use bn.h, so they build in user
+ * space as well.
+ */
+unsigned long long fib_sequence(long long k, bn_t *ret, bn_t *next);
+
+unsigned long long fib_doubling(long long k, bn_t *ret, bn_t *next);
+
+unsigned long long fib_lucas(long long k, bn_t *ret, bn_t *next);
+
+/* a = F(k), b = F(k - 1), both to be freed by the caller */
+bool fib_lucas_pair(long long k, bn_t *a, bn_t *b);
+
+#endif /* _FIB_ENGINE_H */
@@ -0,0 +1,196 @@
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/minmax.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
+
+#include "fib_stats.h"
+#include "fibdrv.h"
+
+#define CREATE_TRACE_POINTS
+#include "fib_trace.h"
+
+/* Result sizes by powers of 16 limbs: <16, <256, <4Ki, <64Ki and more */
+#define FIB_STATS_SIZES 5
+/* Latencies by powers of two ns, the last bucket from 2^35 ns (34 s) up */
+#define FIB_STATS_BUCKETS 36
+
+struct fib_hist {
+    u64 count;
+    u64 ns;
+    u64 bucket[FIB_STATS_BUCKETS];
+};
+
+/*
+ * Every CPU counts into a copy of its own, so recording takes neither a
+ * lock nor an atomic. Reading sums the copies, a request recorded
+ * meanwhile may show in a count but not yet in its bucket.
+ */
+struct fib_stats {
+    struct fib_hist compute[FIB_ALGOS][FIB_STATS_SIZES];
+    struct fib_hist convert[2][FIB_STATS_SIZES]; /* decimal, dec19 */
+    struct fib_hist copy[FIB_STATS_SIZES];
+};
+
+static struct fib_stats __percpu *fib_stats;
+
+static const char *const fib_algo_names[FIB_ALGOS] = {
+    "table",    "cursor",   "cache", "checkpoint",
+    "sequence", "doubling", "lucas",
+};
+
+static const char *const fib_stats_size_names[FIB_STATS_SIZES] = {
+    "<16", "<256", "<4Ki", "<64Ki", ">=64Ki",
+};
+
+static unsigned int fib_stats_size(unsigned long long limbs)
+{
+    return limbs ? min(ilog2(limbs) / 4, FIB_STATS_SIZES - 1) : 0;
+}
+
+static unsigned int fib_stats_bucket(u64 ns)
+{
+    return ns ? min(ilog2(ns), FIB_STATS_BUCKETS - 1) : 0;
+}
+
+#define fib_hist_add(hist, t)                              \
+    do {                                                   \
+        this_cpu_inc((hist).count);                        \
+        this_cpu_add((hist).ns, t);                        \
+        this_cpu_inc((hist).bucket[fib_stats_bucket(t)]);  \
+    } while (0)
+
+/* Without the per-CPU area only the tracepoints are left */
+void fib_stats_init(void)
+{
+    fib_stats = alloc_percpu(struct fib_stats);
+}
+
+void fib_stats_exit(void)
+{
+    free_percpu(fib_stats);
+    fib_stats = NULL;
+}
+
+void fib_stats_compute(long long k,
+                       enum fib_algo algo,
+                       unsigned long long limbs,
+                       u64 ns)
+{
+    trace_fib_compute(k, algo, limbs, ns);
+    if (fib_stats)
+        fib_hist_add(fib_stats->compute[algo][fib_stats_size(limbs)], ns);
+}
+
+/* format is FIB_FORMAT_DECIMAL or FIB_FORMAT_DEC19 */
+void fib_stats_convert(long long k,
+                       unsigned int format,
+                       unsigned long long limbs,
+                       u64 ns)
+{
+    trace_fib_convert(k, format, limbs, ns);
+    if (fib_stats)
+        fib_hist_add(fib_stats->convert[format != FIB_FORMAT_DECIMAL]
+                                       [fib_stats_size(limbs)],
+                     ns);
+}
+
+void fib_stats_copy(long long k, size_t size, u64 ns)
+{
+    trace_fib_copy(k, size, ns);
+    if (fib_stats)
+        fib_hist_add(
+            fib_stats->copy[fib_stats_size(size / sizeof(unsigned long long))],
+            ns);
+}
+
+static void fib_hist_show(struct seq_file *s,
+                          const char *stage,
+                          const char *what,
+                          unsigned int size,
+                          const struct fib_hist *h)
+{
+    if (!h->count)
+        return;
+    seq_printf(s, "%s %s %s %llu %llu", stage, what,
+               fib_stats_size_names[size], h->count,
+               div64_u64(h->ns, h->count));
+    for (int i = 0; i < FIB_STATS_BUCKETS; i++) {
+        if (h->bucket[i])
+            seq_printf(s, " %d:%llu", i, h->bucket[i]);
+    }
+    seq_putc(s, '\n');
+}
+
+static int fib_stats_show(struct seq_file *s, void *unused)
+{
+    struct fib_stats *sum;
+    int cpu;
+
+    if (!fib_stats)
+        return -ENOMEM;
+    sum = kvzalloc(sizeof(*sum), GFP_KERNEL);
+    if (!sum)
+        return -ENOMEM;
+    /* all u64, so the copies add up word by word */
+    for_each_possible_cpu(cpu) {
+        const u64 *src = (const u64 *) per_cpu_ptr(fib_stats, cpu);
+        u64 *dst = (u64 *) sum;
+        for (size_t i = 0; i < sizeof(*sum) / sizeof(u64); i++)
+            dst[i] += src[i];
+    }
+
+    seq_puts(s, "# stage source limbs count avg_ns log2(ns):count...\n");
+    for (int a = 0; a < FIB_ALGOS; a++) {
+        for (int j = 0; j < FIB_STATS_SIZES; j++)
+            fib_hist_show(s, "compute", fib_algo_names[a], j,
+                          &sum->compute[a][j]);
+    }
+    for (int f = 0; f < 2; f++) {
+        for (int j = 0; j < FIB_STATS_SIZES; j++)
+            fib_hist_show(s, "convert", f ? "dec19" : "decimal", j,
+                          &sum->convert[f][j]);
+    }
+    for (int j = 0; j < FIB_STATS_SIZES; j++)
+        fib_hist_show(s, "copy", "-", j, &sum->copy[j]);
+    kvfree(sum);
+    return 0;
+}
+
+static int fib_stats_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, fib_stats_show, NULL);
+}
+
+/* Any write clears the statistics */
+static ssize_t fib_stats_write(struct file *file,
+                               const char __user *buf,
+                               size_t size,
+                               loff_t *pos)
+{
+    int cpu;
+
+    if (fib_stats) {
+        for_each_possible_cpu(cpu)
+            memset(per_cpu_ptr(fib_stats, cpu), 0, sizeof(struct fib_stats));
+    }
+    return size;
+}
+
+static const struct file_operations fib_stats_fops = {
+    .owner = THIS_MODULE,
+    .open = fib_stats_open,
+    .read = seq_read,
+    .write = fib_stats_write,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+void fib_stats_debugfs(struct dentry *dir)
+{
+    debugfs_create_file("stats", 0644, dir, NULL, &fib_stats_fops);
+}
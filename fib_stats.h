@@ -0,0 +1,37 @@
+#ifndef _FIB_STATS_H
+#define _FIB_STATS_H
+#include <linux/types.h>
+
+/* Where a value came from, the algorithm breakdown of the statistics */
+enum fib_algo {
+    FIB_ALGO_TABLE,      /* fib_small */
+    FIB_ALGO_CURSOR,     /* stepped from the file's cursor */
+    FIB_ALGO_CACHE,      /* the result cache */
+    FIB_ALGO_CHECKPOINT, /* seeded from a checkpoint */
+    FIB_ALGO_SEQUENCE,   /* the engines, in the order of fib_engines */
+    FIB_ALGO_DOUBLING,
+    FIB_ALGO_LUCAS,
+    FIB_ALGOS,
+};
+
+struct dentry;
+
+void fib_stats_init(void);
+
+void fib_stats_exit(void);
+
+void fib_stats_compute(long long k,
+                       enum fib_algo algo,
+                       unsigned long long limbs,
+                       u64 ns);
+
+void fib_stats_convert(long long k,
+                       unsigned int format,
+                       unsigned long long limbs,
+                       u64 ns);
+
+void fib_stats_copy(long long k, size_t size, u64 ns);
+
+void fib_stats_debugfs(struct dentry *dir);
+
+#endif /* _FIB_STATS_H */
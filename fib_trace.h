@@ -0,0 +1,87 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM fibdrv
+
+#if !defined(_FIB_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _FIB_TRACE_H
+#include <linux/tracepoint.h>
+
+#include "fib_stats.h"
+
+/*
+ * Stage boundaries of a request: fib_request when it starts, then one
+ * event as each of computing, converting and copying out ends
+ */
+TRACE_EVENT(fib_request,
+            TP_PROTO(long long k, unsigned int format),
+            TP_ARGS(k, format),
+            TP_STRUCT__entry(__field(long long, k)
+                             __field(unsigned int, format)),
+            TP_fast_assign(__entry->k = k; __entry->format = format;),
+            TP_printk("k=%lld format=%u", __entry->k, __entry->format));
+
+/* so that tools reading the format file can resolve __print_symbolic */
+TRACE_DEFINE_ENUM(FIB_ALGO_TABLE);
+TRACE_DEFINE_ENUM(FIB_ALGO_CURSOR);
+TRACE_DEFINE_ENUM(FIB_ALGO_CACHE);
+TRACE_DEFINE_ENUM(FIB_ALGO_CHECKPOINT);
+TRACE_DEFINE_ENUM(FIB_ALGO_SEQUENCE);
+TRACE_DEFINE_ENUM(FIB_ALGO_DOUBLING);
+TRACE_DEFINE_ENUM(FIB_ALGO_LUCAS);
+
+TRACE_EVENT(fib_compute,
+            TP_PROTO(long long k,
+                     enum fib_algo algo,
+                     unsigned long long limbs,
+                     u64 ns),
+            TP_ARGS(k, algo, limbs, ns),
+            TP_STRUCT__entry(__field(long long, k)
+                             __field(unsigned int, algo)
+                             __field(unsigned long long, limbs)
+                             __field(u64, ns)),
+            TP_fast_assign(__entry->k = k; __entry->algo = algo;
+                           __entry->limbs = limbs; __entry->ns = ns;),
+            TP_printk("k=%lld algo=%s limbs=%llu ns=%llu", __entry->k,
+                      __print_symbolic(__entry->algo,
+                                       {FIB_ALGO_TABLE, "table"},
+                                       {FIB_ALGO_CURSOR, "cursor"},
+                                       {FIB_ALGO_CACHE, "cache"},
+                                       {FIB_ALGO_CHECKPOINT, "checkpoint"},
+                                       {FIB_ALGO_SEQUENCE, "sequence"},
+                                       {FIB_ALGO_DOUBLING, "doubling"},
+                                       {FIB_ALGO_LUCAS, "lucas"}),
+                      __entry->limbs, __entry->ns));
+
+TRACE_EVENT(fib_convert,
+            TP_PROTO(long long k,
+                     unsigned int format,
+                     unsigned long long limbs,
+                     u64 ns),
+            TP_ARGS(k, format, limbs, ns),
+            TP_STRUCT__entry(__field(long long, k)
+                             __field(unsigned int, format)
+                             __field(unsigned long long, limbs)
+                             __field(u64, ns)),
+            TP_fast_assign(__entry->k = k; __entry->format = format;
+                           __entry->limbs = limbs; __entry->ns = ns;),
+            TP_printk("k=%lld format=%u limbs=%llu ns=%llu", __entry->k,
+                      __entry->format, __entry->limbs, __entry->ns));
+
+TRACE_EVENT(fib_copy,
+            TP_PROTO(long long k, size_t size, u64 ns),
+            TP_ARGS(k, size, ns),
+            TP_STRUCT__entry(__field(long long, k)
+                             __field(size_t, size)
+                             __field(u64, ns)),
+            TP_fast_assign(__entry->k = k; __entry->size = size;
+                           __entry->ns = ns;),
+            TP_printk("k=%lld size=%zu ns=%llu", __entry->k, __entry->size,
+                      __entry->ns));
+
+#endif /* _FIB_TRACE_H */
+
+/* the kernel's define_trace.h looks for this file by these */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE fib_trace
+#include <trace/define_trace.h>
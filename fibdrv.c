@@ -1,14 +1,28 @@
 #include <linux/cdev.h>
+#include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/fs.h>
 #include <linux/init.h>
 #include <linux/kdev_t.h>
 #include <linux/kernel.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #include "bn.h"
+#include "bn_dec.h"
+#include "fib_cache.h"
+#include "fib_checkpoint.h"
+#include "fib_engine.h"
+#include "fib_stats.h"
+#include "fib_trace.h"
+#include "fibdrv.h"
 
 MODULE_LICENSE("Dual MIT/GPL");
 MODULE_AUTHOR("National Cheng Kung University, Taiwan");
@@ -16,187 +30,1159 @@ MODULE_DESCRIPTION("Fibonacci engine driver");
 MODULE_VERSION("0.1");
 
 #define DEV_FIBONACCI_NAME "fibonacci"
-#define DOUBLING
-
-/* MAX_LENGTH is set to 92 because
- * ssize_t can't fit the number > 92
+/* Default engine of fib_read: fib_sequence, fib_doubling, fib_lucas, or
+ * NULL to pick one by k. Can be overridden at build time with
+ * `make ENGINE=...` and at run time with the engine parameter.
  */
-#define MAX_LENGTH 92
+#ifndef FIB_ENGINE
+#define FIB_ENGINE NULL
+#endif
+
+module_param_named(karatsuba_threshold, bn_karatsuba_threshold, uint, 0644);
+MODULE_PARM_DESC(karatsuba_threshold,
+                 "Limb count at which bn_mult switches to Karatsuba");
+module_param_named(toom3_threshold, bn_toom3_threshold, uint, 0644);
+MODULE_PARM_DESC(toom3_threshold,
+                 "Limb count at which bn_mult switches to Toom-3");
+module_param_named(ntt_threshold, bn_ntt_threshold, uint, 0644);
+MODULE_PARM_DESC(ntt_threshold,
+                 "Limb count at which bn_mult switches to the NTT");
+module_param_named(parallel_threshold, bn_parallel_threshold, uint, 0644);
+MODULE_PARM_DESC(parallel_threshold,
+                 "Limb count at which products use several CPUs, 0 disables");
+
+static bool use_arena = true;
+module_param(use_arena, bool, 0644);
+MODULE_PARM_DESC(use_arena, "Carve bignum temporaries from a per-file arena");
+
+static bool use_cursor = true;
+module_param(use_cursor, bool, 0644);
+MODULE_PARM_DESC(use_cursor, "Serve reads just past the last one by stepping");
+
+module_param_named(cache_size, fib_cache_size, uint, 0644);
+MODULE_PARM_DESC(cache_size, "KiB of finished results to cache, 0 disables");
+
+module_param_named(checkpoint_gap, fib_checkpoint_gap, uint, 0644);
+MODULE_PARM_DESC(checkpoint_gap,
+                 "Minimum distance between checkpoints, 0 disables");
+module_param_named(checkpoint_size, fib_checkpoint_size, uint, 0644);
+MODULE_PARM_DESC(checkpoint_size, "KiB of (F(m), F(m+1)) checkpoints to keep");
 
 static dev_t fib_dev = 0;
 static struct cdev *fib_cdev;
 static struct class *fib_class;
-static DEFINE_MUTEX(fib_mutex);
+static struct dentry *fib_debugfs;
+
+/* Per-open-file state, stored in file->private_data.
+ * The lock only serializes threads sharing the same file,
+ * different files can compute concurrently.
+ */
+struct fib_session {
+    struct mutex lock;
+    ktime_t kt;
+    ktime_t k_to_ut;
+    unsigned long long allocs;
+    unsigned long long alloc_ns;
+    ktime_t dec_kt;
+    unsigned int format; /* FIB_FORMAT_* of reads and commands */
+    /* guards arena, a busy arena makes a read use a private one */
+    struct mutex arena_lock;
+    struct bn_arena arena;
+    /*
+     * guards the cursor, the pair (F(cursor), F(cursor + 1)) in cur[0..1]
+     * kept from the last read; cursor is -1 while there is none
+     */
+    struct mutex cursor_lock;
+    long long cursor;
+    bn_t cur[3];
+    /* guards the copy of F(stream_k) a chunked read is handing out */
+    struct mutex stream_lock;
+    long long stream_k;
+    unsigned int stream_format; /* the format stream is in */
+    char *stream;
+    size_t stream_size, stream_pos;
+    /*
+     * guards the FIB_IOC_SUBMIT requests, running ones in async_pending
+     * and finished ones in async_done until FIB_IOC_REAP takes them
+     */
+    struct mutex async_lock;
+    struct list_head async_pending, async_done;
+    unsigned int async_count;
+    wait_queue_head_t async_wait;
+};
+
+/* Values alive at once in fib_doubling: a, b, t2 and their three products */
+#define FIB_ARENA_BLOCKS 6
+
+/* Products fib_doubling runs at once, each may need scratch of its own */
+#define FIB_PRODUCTS 3
+
+/*
+ * Values the size of F(k) kept beside the arena: F(k+1), the cursor pair,
+ * the cache entry, and the output, up to about 2.5 values and as many
+ * temporaries in decimal
+ */
+#define FIB_COPIES 8
+
+/* Computations needing fewer bytes are not counted against memory */
+#define FIB_MEM_MIN (1 << 20)
+
+/*
+ * Limbs a file's arena keeps between reads, a larger one is freed after
+ * use; nor is the cursor set on values that would take more
+ */
+#define FIB_ARENA_KEEP (1 << 17)
+
+/* Largest k whose F(k) fits in one limb */
+#define FIB_SMALL_MAX 93
+
+/* Offsets below this are cheap enough to skip the checkpoint table */
+#define FIB_CHECKPOINT_MIN 4096
+
+/* Largest forward seek the cursor covers by stepping */
+#define FIB_CURSOR_STEPS 128
+
+/* F(k) has about k * log2(phi) = 0.6942k bits, 711/1024 rounds that up */
+static unsigned long long fib_limbs(long long k)
+{
+    return ((k >> 10) * 711 + ((k & 1023) * 711 >> 10)) / 64 + 2;
+}
+
+/*
+ * Bytes computing F(k) may hold at its peak: the arena fib_arena_get
+ * reserves, scratch for FIB_PRODUCTS products at once and FIB_COPIES
+ * values beside.
+ */
+static unsigned long long fib_mem_need(long long k)
+{
+    unsigned long long len = fib_limbs(k) + 4;
+
+    return sizeof(unsigned long long) *
+           ((FIB_ARENA_BLOCKS + FIB_COPIES) * len +
+            FIB_PRODUCTS * bn_scratch_max(len));
+}
+
+static unsigned long long fib_mem_avail(void)
+{
+    return (unsigned long long) si_mem_available() << PAGE_SHIFT;
+}
 
-static ktime_t kt;
-static ktime_t k_to_ut;
-// cppcheck-suppress unusedFunction
-static unsigned long long fib_sequence(long long k, bn_t *ret)
+/*
+ * Whether F(k) could not be computed even with no other computation. An
+ * offset past 2^63 comes in negative.
+ */
+static bool fib_too_big(long long k)
+{
+    if (k < 0)
+        return true;
+    if (k <= FIB_SMALL_MAX)
+        return false;
+    unsigned long long need = fib_mem_need(k);
+    return need >= FIB_MEM_MIN && need > fib_mem_avail();
+}
+
+/* Largest offset fib_too_big lets through, found by bisection */
+static long long fib_max_offset(void)
 {
-    /* FIXME: use clz/ctz and fast algorithms to speed up */
-    if (k == 0 || k == 1) {
-        ret->num = kmalloc(sizeof(unsigned long long), GFP_KERNEL);
-        ret->num[0] = k;
-        ret->length = 1;
-        return 1;
+    unsigned long long avail = fib_mem_avail();
+    long long lo = FIB_SMALL_MAX;
+    long long hi = avail / sizeof(unsigned long long) / 711 * (64 << 10);
+
+    while (lo < hi) {
+        long long mid = lo + (hi - lo + 1) / 2;
+        if (fib_mem_need(mid) > avail)
+            hi = mid - 1;
+        else
+            lo = mid;
     }
+    return lo;
+}
+
+/*
+ * Bytes held by the computations running on all files, each reserved with
+ * fib_mem_get. Those waiting for room sleep on fib_mem_wait.
+ */
+static atomic64_t fib_mem_held = ATOMIC64_INIT(0);
+static DECLARE_WAIT_QUEUE_HEAD(fib_mem_wait);
 
-    bn_t a, b, res = {};
-    bn_znew(&a, 1);
-    bn_znew(&b, 1);
+static void fib_mem_put(unsigned long long held)
+{
+    if (!held)
+        return;
+    atomic64_sub(held, &fib_mem_held);
+    wake_up_interruptible_all(&fib_mem_wait);
+}
+
+/*
+ * Reserve the memory computing F(k) needs, so that computations running at
+ * once do not add up to more than is available and fail halfway. Waits for
+ * others to finish if they hold the room; EFBIG if F(k) does not fit even
+ * alone. *held is what to give back with fib_mem_put, 0 for a computation
+ * too small to count.
+ */
+static int fib_mem_get(long long k, unsigned long long *held)
+{
+    unsigned long long need = fib_mem_need(k);
 
-    if (!a.num || !b.num) {
-        bn_free(&a);
-        bn_free(&b);
+    *held = 0;
+    if (need < FIB_MEM_MIN)
         return 0;
-    }
-    a.num[0] = 0;
-    b.num[0] = 1;
-    bool err = false;
-    for (int i = 2; i <= k; i++) {
-        if (!bn_add(&a, &b, &res)) {
-            err = true;
-            break;
+    for (;;) {
+        s64 others = atomic64_add_return(need, &fib_mem_held) - need;
+        if (others + need <= fib_mem_avail()) {
+            *held = need;
+            return 0;
         }
-        bn_swap(&a, &b);
-        bn_swap(&b, &res);
+        /* a waiter may have checked while this was added and slept again */
+        fib_mem_put(need);
+        if (!others)
+            return -EFBIG;
+        if (wait_event_interruptible(fib_mem_wait,
+                                     atomic64_read(&fib_mem_held) < others))
+            return -ERESTARTSYS;
     }
-    bn_free(&a);
-    bn_free(&res);
-    bn_swap(ret, &b);
-    if (err) {
-        bn_free(ret);
+}
+
+typedef unsigned long long fib_engine_fn(long long k, bn_t *ret, bn_t *next);
+
+/* Engine i is FIB_ALGO_SEQUENCE + i in the statistics */
+static const struct {
+    const char *name;
+    fib_engine_fn *fn;
+} fib_engines[] = {
+    {"sequence", fib_sequence},
+    {"doubling", fib_doubling},
+    {"lucas", fib_lucas},
+};
+
+#define FIB_ENGINE_LUCAS 2
+
+/* The engine of fib_read, NULL picks the fastest for k from fib_auto */
+static fib_engine_fn *fib_engine = FIB_ENGINE;
+
+static int fib_engine_set(const char *val, const struct kernel_param *kp)
+{
+    if (sysfs_streq(val, "auto")) {
+        WRITE_ONCE(fib_engine, NULL);
         return 0;
     }
-    return ret->length;
+    for (int i = 0; i < ARRAY_SIZE(fib_engines); i++) {
+        if (sysfs_streq(val, fib_engines[i].name)) {
+            WRITE_ONCE(fib_engine, fib_engines[i].fn);
+            return 0;
+        }
+    }
+    return -EINVAL;
 }
-// cppcheck-suppress unusedFunction
-static unsigned long long fib_doubling(long long k, bn_t *ret)
+
+static int fib_engine_get(char *buf, const struct kernel_param *kp)
 {
-    if (k == 0 || k == 1) {
-        ret->num = kmalloc(sizeof(unsigned long long), GFP_KERNEL);
-        ret->num[0] = k;
-        ret->length = 1;
-        return 1;
+    fib_engine_fn *fn = READ_ONCE(fib_engine);
+    const char *name = "auto";
+
+    for (int i = 0; i < ARRAY_SIZE(fib_engines); i++) {
+        if (fib_engines[i].fn == fn)
+            name = fib_engines[i].name;
     }
+    return scnprintf(buf, PAGE_SIZE, "%s\n", name);
+}
 
-    bn_t a, b;
-    bn_znew(&a, 2);
-    bn_znew(&b, 2);
-    int bits = 32 - __builtin_clz(k);
-    if (!a.num || !b.num) {
-        bn_free(&a);
-        bn_free(&b);
-        return 0;
+static const struct kernel_param_ops fib_engine_ops = {
+    .set = fib_engine_set,
+    .get = fib_engine_get,
+};
+module_param_cb(engine, &fib_engine_ops, NULL, 0644);
+MODULE_PARM_DESC(engine, "sequence, doubling, lucas, or auto to pick by k");
+
+static bool tune = true;
+module_param(tune, bool, 0444);
+MODULE_PARM_DESC(tune,
+                 "Time multiplication thresholds and engines at load, "
+                 "or keep the given thresholds and use lucas for auto");
+
+/* Offsets up to 2^(FIB_AUTO_BITS + 1) are timed, larger ones follow them */
+#define FIB_AUTO_BITS 18
+
+/*
+ * The engine auto mode runs for k of each bit length, fastest when timed
+ * at load, and the ns every engine took, 0 if it was not timed
+ */
+static u8 fib_auto[64] = {[0 ... 63] = FIB_ENGINE_LUCAS};
+static u64 fib_auto_ns[FIB_AUTO_BITS + 1][ARRAY_SIZE(fib_engines)];
+
+/* Index in fib_engines of the engine to compute F(k) with */
+static int fib_engine_pick(long long k)
+{
+    fib_engine_fn *fn = READ_ONCE(fib_engine);
+
+    for (int i = 0; i < ARRAY_SIZE(fib_engines); i++) {
+        if (fib_engines[i].fn == fn)
+            return i;
     }
-    a.num[0] = 0;
-    b.num[0] = 1;
-    bool err = false;
-    for (int i = bits - 1; i >= 0; i--) {
-        bn_t t1 = {}, t2 = {}, t3 = {}, t4 = {};
-        err |= !bn_new(&t1, b.length);
-        err |= !bn_move(&b, &t1);
-        err |= !bn_lshift(&t1, 1);     // t1 = 2*b
-        err |= !bn_sub(&t1, &a, &t2);  // t2 = 2*b - a
-        err |= !bn_new(&t3, a.length);
-        err |= !bn_move(&a, &t3);   // t3 = a
-        err |= !bn_mult(&t3, &t2);  // t2 = a*(2*b -a);
-
-        err |= !bn_mult(&a, &t3);
-        err |= !bn_move(&b, &t1);
-        err |= !bn_mult(&b, &t1);
-        err |= !bn_add(&t1, &t3, &t4);  // t4 = a^2 + b^2;
-
-        err |= !bn_extend(&a, t2.length);
-        err |= !bn_extend(&b, t4.length);
-        err |= !bn_move(&t2, &a);
-        err |= !bn_move(&t4, &b);
-
-        if (k & 1 << i) {
-            err |= !bn_add(&a, &b, &t1);  // t1 = a+b
-            err |= !bn_extend(&a, b.length);
-            err |= !bn_move(&b, &a);  // a = b
-            err |= !bn_extend(&b, t1.length);
-            err |= !bn_move(&t1, &b);  // b = t1
+    return fib_auto[k ? ilog2(k) : 0];
+}
+
+/*
+ * Times every engine at k = 1.5 * 2^bits for each bit length up to
+ * FIB_AUTO_BITS, best of three, and keeps the fastest. fib_sequence is
+ * quadratic and only falls further behind, so once it is more than twice
+ * as slow as the fastest it is not timed for longer k again.
+ */
+static void fib_auto_tune(void)
+{
+    bool sequence = true;
+    int best = FIB_ENGINE_LUCAS;
+
+    for (int bits = 0; bits <= FIB_AUTO_BITS; bits++) {
+        long long k = bits ? 3LL << (bits - 1) : 1;
+        u64 best_ns = U64_MAX;
+
+        for (int i = 0; i < ARRAY_SIZE(fib_engines); i++) {
+            u64 ns = U64_MAX;
+            if (fib_engines[i].fn == fib_sequence && !sequence)
+                continue;
+            for (int round = 0; round < 3; round++) {
+                bn_t f = {};
+                ktime_t kt = ktime_get();
+                bool ok = fib_engines[i].fn(k, &f, NULL);
+                kt = ktime_sub(ktime_get(), kt);
+                bn_free(&f);
+                if (ok)
+                    ns = min_t(u64, ns, ktime_to_ns(kt));
+            }
+            fib_auto_ns[bits][i] = ns;
+            if (ns < best_ns) {
+                best_ns = ns;
+                best = i;
+            }
+            cond_resched();
         }
+        sequence &= fib_auto_ns[bits][0] / 2 <= best_ns;
+        fib_auto[bits] = best;
+    }
+    for (int bits = FIB_AUTO_BITS + 1; bits < ARRAY_SIZE(fib_auto); bits++)
+        fib_auto[bits] = best;
+}
 
-        bn_free(&t1);
-        bn_free(&t2);
-        bn_free(&t3);
-        bn_free(&t4);
-        if (err)
-            break;
+/*
+ * The multiplication thresholds, then the engine auto mode picks by bit
+ * length of k and the timings behind it
+ */
+static int fib_engines_show(struct seq_file *s, void *unused)
+{
+    seq_printf(s, "# karatsuba %u toom3 %u ntt %u\n", bn_karatsuba_threshold,
+               bn_toom3_threshold, bn_ntt_threshold);
+    seq_puts(s, "# bits engine");
+    for (int i = 0; i < ARRAY_SIZE(fib_engines); i++)
+        seq_printf(s, " %s_ns", fib_engines[i].name);
+    seq_putc(s, '\n');
+    for (int bits = 0; bits < ARRAY_SIZE(fib_auto); bits++) {
+        seq_printf(s, "%d %s", bits, fib_engines[fib_auto[bits]].name);
+        for (int i = 0; bits <= FIB_AUTO_BITS && i < ARRAY_SIZE(fib_engines);
+             i++)
+            seq_printf(s, " %llu", fib_auto_ns[bits][i]);
+        seq_putc(s, '\n');
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(fib_engines);
+
+/*
+ * F(m+n) = F(m+1)F(n) + F(m)F(n-1), so F(k) follows from a checkpoint
+ * (F(m), F(m+1)) and the much smaller pair (F(n), F(n-1)), n = k - m.
+ * next, if given, gets F(k+1) = F(m+1)F(n+1) + F(m)F(n).
+ */
+static bool fib_from_checkpoint(const struct fib_checkpoint *cp,
+                                long long k,
+                                bn_t *ret,
+                                bn_t *next)
+{
+    struct bn_arena *arena = ret->arena;
+    bn_t a = {.arena = arena}, b = {.arena = arena};
+    bn_t x = {.arena = arena}, y = {.arena = arena};
+    bool err = !fib_lucas_pair(k - cp->m, &a, &b);  // F(n), F(n-1)
+
+    if (next && !err) {
+        err |= !fib_checkpoint_load(cp, 0, next);
+        err |= !fib_checkpoint_load(cp, 1, &x);
+        err |= !bn_add(&a, &b, &y);  // y = F(n+1)
+        /* next = F(m)F(n), x = F(m+1)F(n+1) */
+        struct bn_mul_op ops[] = {{&a, next}, {&y, &x}};
+        err |= !bn_mul_many(ops, 2);
+        err |= !bn_add(&x, next, &y);
+        bn_swap(next, &y);
+    }
+    if (!err) {
+        err |= !fib_checkpoint_load(cp, 0, &y);
+        err |= !fib_checkpoint_load(cp, 1, &x);
+        /* y = F(m)F(n-1), x = F(m+1)F(n) */
+        struct bn_mul_op ops[] = {{&b, &y}, {&a, &x}};
+        err |= !bn_mul_many(ops, 2);
+        err |= !bn_add(&x, &y, ret);
     }
-    bn_swap(&a, ret);
     bn_free(&a);
     bn_free(&b);
+    bn_free(&x);
+    bn_free(&y);
+    return !err;
+}
+
+/*
+ * F(k) for fib_read: seeded from the nearest checkpoint below k when there
+ * is one close enough, otherwise computed by the engine fib_engine_pick
+ * chooses. When the checkpoint density allows, (F(k), F(k+1)) is kept as a
+ * new checkpoint; every way of computing F(k) gives F(k+1) along with it.
+ * next, if given, gets F(k+1) too. algo is set to the way taken.
+ */
+static unsigned long long fib_compute(long long k,
+                                      bn_t *ret,
+                                      bn_t *next,
+                                      enum fib_algo *algo)
+{
+    struct fib_checkpoint *cp = NULL;
+    bool keep = false;
+
+    if (k >= FIB_CHECKPOINT_MIN) {
+        cp = fib_checkpoint_find(k);
+        keep = fib_checkpoint_wanted(k);
+    }
+
+    bn_t f = {.arena = ret->arena}, h = {.arena = ret->arena};
+    bn_t *fk1 = keep || next ? &h : NULL;
+    bool err;
+    if (cp) {
+        *algo = FIB_ALGO_CHECKPOINT;
+        err = !fib_from_checkpoint(cp, k, &f, fk1);
+        fib_checkpoint_put(cp);
+    } else {
+        int i = fib_engine_pick(k);
+        *algo = FIB_ALGO_SEQUENCE + i;
+        err = !fib_engines[i].fn(k, &f, fk1);
+    }
+    if (!err) {
+        bn_shrink(&f);
+        if (fk1)
+            bn_shrink(&h);
+        if (keep)
+            fib_checkpoint_add(k, &f, &h);
+        if (next)
+            bn_swap(&h, next);
+    }
+    bn_free(&h);
     if (err) {
-        bn_free(ret);
+        bn_free(&f);
         return 0;
     }
+    bn_swap(&f, ret);
+    bn_free(&f);
     return ret->length;
 }
 
-static int fib_open(struct inode *inode, struct file *file)
+/* Point the cursor of sess at k, given F(k) and F(k+1) */
+static void fib_cursor_set(struct fib_session *sess,
+                           long long k,
+                           const bn_t *fk,
+                           const bn_t *fk1)
 {
-    if (!mutex_trylock(&fib_mutex)) {
-        printk(KERN_ALERT "fibdrv is in use");
-        return -EBUSY;
+    const bn_t *v[2] = {fk, fk1};
+
+    sess->cursor = -1;
+    for (int i = 0; i < 2; i++) {
+        if (!bn_copy(&sess->cur[i], v[i]))
+            return;
+    }
+    sess->cursor = k;
+}
+
+/*
+ * Step the cursor of sess forward to k, one addition per offset. Fails
+ * when k lies behind the cursor or too far ahead of it.
+ */
+static bool fib_cursor_seek(struct fib_session *sess, long long k)
+{
+    if (sess->cursor < 0 || k < sess->cursor ||
+        k - sess->cursor > FIB_CURSOR_STEPS)
+        return false;
+    while (sess->cursor < k) {
+        /* cur[2] is a spare, rotated to keep its memory for the next step */
+        if (!bn_add(&sess->cur[0], &sess->cur[1], &sess->cur[2])) {
+            sess->cursor = -1;
+            return false;
+        }
+        bn_swap(&sess->cur[0], &sess->cur[1]);
+        bn_swap(&sess->cur[1], &sess->cur[2]);
+        sess->cursor++;
     }
+    bn_shrink(&sess->cur[0]);
+    return true;
+}
+
+static int fib_open(struct inode *inode, struct file *file)
+{
+    struct fib_session *sess = kzalloc(sizeof(*sess), GFP_KERNEL);
+    if (!sess)
+        return -ENOMEM;
+    mutex_init(&sess->lock);
+    mutex_init(&sess->arena_lock);
+    mutex_init(&sess->cursor_lock);
+    mutex_init(&sess->stream_lock);
+    mutex_init(&sess->async_lock);
+    INIT_LIST_HEAD(&sess->async_pending);
+    INIT_LIST_HEAD(&sess->async_done);
+    init_waitqueue_head(&sess->async_wait);
+    sess->cursor = -1;
+    file->private_data = sess;
     return 0;
 }
 
+static void fib_async_drain(struct fib_session *sess);
+
 static int fib_release(struct inode *inode, struct file *file)
 {
-    mutex_unlock(&fib_mutex);
+    struct fib_session *sess = file->private_data;
+    fib_async_drain(sess);
+    bn_arena_release(&sess->arena);
+    for (int i = 0; i < 3; i++)
+        bn_free(&sess->cur[i]);
+    kvfree(sess->stream);
+    mutex_destroy(&sess->async_lock);
+    mutex_destroy(&sess->stream_lock);
+    mutex_destroy(&sess->cursor_lock);
+    mutex_destroy(&sess->arena_lock);
+    mutex_destroy(&sess->lock);
+    kfree(sess);
     return 0;
 }
 
-/* calculate the fibonacci number at given offset */
+/*
+ * Arena for values up to F(k): the file's own one, or the empty local one
+ * if another thread sharing the file holds it.
+ */
+static struct bn_arena *fib_arena_get(struct fib_session *sess,
+                                      struct bn_arena *local,
+                                      long long k)
+{
+    struct bn_arena *arena = local;
+    if (use_arena && mutex_trylock(&sess->arena_lock))
+        arena = &sess->arena;
+    arena->heap_allocs = arena->heap_ns = 0;
+    if (use_arena)
+        bn_arena_reserve(arena, fib_limbs(k) + 4, FIB_ARENA_BLOCKS);
+    return arena;
+}
+
+/*
+ * The file's arena is kept for the next read unless one large offset grew
+ * it past FIB_ARENA_KEEP limbs, so a long-lived file does not pin memory
+ * sized for the largest value it ever read.
+ */
+static void fib_arena_put(struct fib_session *sess, struct bn_arena *arena)
+{
+    if (arena != &sess->arena) {
+        bn_arena_release(arena);
+        return;
+    }
+    if (arena->nblocks * arena->block_len + arena->scratch_len >
+        FIB_ARENA_KEEP)
+        bn_arena_release(arena);
+    mutex_unlock(&sess->arena_lock);
+}
+
+/* F(0)..F(93), all that fit in one limb, served without bignum code */
+static const unsigned long long fib_small[FIB_SMALL_MAX + 1] = {
+    0ULL, 1ULL, 1ULL, 2ULL, 3ULL, 5ULL, 8ULL, 13ULL, 21ULL, 34ULL, 55ULL, 89ULL,
+    144ULL, 233ULL, 377ULL, 610ULL, 987ULL, 1597ULL, 2584ULL, 4181ULL, 6765ULL,
+    10946ULL, 17711ULL, 28657ULL, 46368ULL, 75025ULL, 121393ULL, 196418ULL,
+    317811ULL, 514229ULL, 832040ULL, 1346269ULL, 2178309ULL, 3524578ULL,
+    5702887ULL, 9227465ULL, 14930352ULL, 24157817ULL, 39088169ULL, 63245986ULL,
+    102334155ULL, 165580141ULL, 267914296ULL, 433494437ULL, 701408733ULL,
+    1134903170ULL, 1836311903ULL, 2971215073ULL, 4807526976ULL, 7778742049ULL,
+    12586269025ULL, 20365011074ULL, 32951280099ULL, 53316291173ULL,
+    86267571272ULL, 139583862445ULL, 225851433717ULL, 365435296162ULL,
+    591286729879ULL, 956722026041ULL, 1548008755920ULL, 2504730781961ULL,
+    4052739537881ULL, 6557470319842ULL, 10610209857723ULL, 17167680177565ULL,
+    27777890035288ULL, 44945570212853ULL, 72723460248141ULL, 117669030460994ULL,
+    190392490709135ULL, 308061521170129ULL, 498454011879264ULL,
+    806515533049393ULL, 1304969544928657ULL, 2111485077978050ULL,
+    3416454622906707ULL, 5527939700884757ULL, 8944394323791464ULL,
+    14472334024676221ULL, 23416728348467685ULL, 37889062373143906ULL,
+    61305790721611591ULL, 99194853094755497ULL, 160500643816367088ULL,
+    259695496911122585ULL, 420196140727489673ULL, 679891637638612258ULL,
+    1100087778366101931ULL, 1779979416004714189ULL, 2880067194370816120ULL,
+    4660046610375530309ULL, 7540113804746346429ULL, 12200160415121876738ULL,
+};
+
+/*
+ * F(k) for one request, from the table, the cursor, the cache or a
+ * computation
+ */
+struct fib_result {
+    const void *out; /* num or dec, size bytes for user space */
+    size_t size;
+    unsigned int format; /* FIB_FORMAT_* of out */
+    void *dec;      /* decimal digits or base 10^19 limbs */
+    ktime_t dec_kt; /* time converting to them */
+    const unsigned long long *num;
+    unsigned long long length;
+    enum fib_algo algo; /* where num came from */
+    ktime_t kt;         /* time getting it */
+    bool cursor; /* holds cursor_lock */
+    struct fib_cache_entry *hit;
+    struct bn_arena local, *arena;
+    bn_t res;
+    unsigned long long mem; /* from fib_mem_get */
+    int err;                /* why length is 0, if not for memory */
+};
+
+static unsigned long long fib_get_limbs(struct fib_session *sess,
+                                        long long k,
+                                        struct fib_result *r)
+{
+    if (k <= FIB_SMALL_MAX) {
+        r->num = &fib_small[k];
+        r->length = 1;
+        r->algo = FIB_ALGO_TABLE;
+        return r->length;
+    }
+    /* a busy cursor means another thread shares this file, skip it */
+    r->cursor = use_cursor && mutex_trylock(&sess->cursor_lock);
+    if (r->cursor && fib_cursor_seek(sess, k)) {
+        r->num = sess->cur[0].num;
+        r->length = sess->cur[0].length;
+        r->algo = FIB_ALGO_CURSOR;
+    } else if ((r->hit = fib_cache_lookup(k))) {
+        r->num = r->hit->num;
+        r->length = r->hit->length;
+        r->algo = FIB_ALGO_CACHE;
+    } else if (!(r->err = fib_mem_get(k, &r->mem))) {
+        /* the cursor's three values stay for as long as the file is open */
+        bool keep = r->cursor && 3 * fib_limbs(k) <= FIB_ARENA_KEEP;
+        r->arena = fib_arena_get(sess, &r->local, k);
+        r->res.arena = r->arena;
+        bn_t next = {.arena = r->arena};
+        r->length = fib_compute(k, &r->res, keep ? &next : NULL, &r->algo);
+        if (r->length && keep)
+            fib_cursor_set(sess, k, &r->res, &next);
+        bn_free(&next);
+        r->num = r->res.num;
+    }
+    return r->length;
+}
+
+/*
+ * F(k) in the given output format, returns its size in bytes. Getting
+ * the limbs and converting them are timed apart and go to the statistics.
+ */
+static size_t fib_get(struct fib_session *sess,
+                      long long k,
+                      unsigned int format,
+                      struct fib_result *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->format = format;
+    trace_fib_request(k, format);
+    r->kt = ktime_get();
+    fib_get_limbs(sess, k, r);
+    r->kt = ktime_sub(ktime_get(), r->kt);
+    if (!r->length)
+        return 0;
+    fib_stats_compute(k, r->algo, r->length, ktime_to_ns(r->kt));
+    r->out = r->num;
+    r->size = r->length * sizeof(unsigned long long);
+    if (format == FIB_FORMAT_BINARY)
+        return r->size;
+
+    r->dec_kt = ktime_get();
+    if (format == FIB_FORMAT_DECIMAL) {
+        r->dec = bn_dec(r->num, r->length, &r->size);
+    } else {
+        r->dec = bn_dec19(r->num, r->length, &r->size);
+        r->size *= sizeof(unsigned long long);
+    }
+    r->dec_kt = ktime_sub(ktime_get(), r->dec_kt);
+    r->out = r->dec;
+    if (!r->dec)
+        r->size = 0;
+    else
+        fib_stats_convert(k, format, r->length, ktime_to_ns(r->dec_kt));
+    return r->size;
+}
+
+/* Done with r, a computed result goes to the cache */
+static void fib_put(struct fib_session *sess, long long k, struct fib_result *r)
+{
+    kvfree(r->dec);
+    if (r->hit) {
+        fib_cache_put(r->hit);
+    } else if (r->arena) {
+        if (r->res.num)
+            fib_cache_insert(k, r->res.num, r->res.length);
+        bn_free(&r->res);
+        fib_arena_put(sess, r->arena);
+    }
+    fib_mem_put(r->mem);
+    if (r->cursor)
+        mutex_unlock(&sess->cursor_lock);
+}
+
+/* Record the costs of the file's last request for write to report */
+static void fib_session_stats(struct fib_session *sess,
+                              ktime_t k_to_ut,
+                              const struct fib_result *r)
+{
+    mutex_lock(&sess->lock);
+    sess->kt = r->kt;
+    sess->dec_kt = r->dec_kt;
+    sess->k_to_ut = k_to_ut;
+    sess->allocs = r->arena ? r->arena->heap_allocs : 0;
+    sess->alloc_ns = r->arena ? r->arena->heap_ns : 0;
+    mutex_unlock(&sess->lock);
+}
+
+static void fib_stream_stop(struct fib_session *sess)
+{
+    kvfree(sess->stream);
+    sess->stream = NULL;
+    sess->stream_size = sess->stream_pos = 0;
+}
+
+/*
+ * Hand stream, the size bytes of F(k) in format, over to sess, the next
+ * reads at k continue from pos
+ */
+static void fib_stream_hold(struct fib_session *sess,
+                            long long k,
+                            unsigned int format,
+                            char *stream,
+                            size_t size,
+                            size_t pos)
+{
+    mutex_lock(&sess->stream_lock);
+    fib_stream_stop(sess);
+    sess->stream = stream;
+    sess->stream_k = k;
+    sess->stream_format = format;
+    sess->stream_size = size;
+    sess->stream_pos = pos;
+    mutex_unlock(&sess->stream_lock);
+}
+
+/*
+ * Hold F(k) in sess, the next reads at k continue from pos. A converted
+ * value is handed over as it is, limbs are copied. r->out is not to be
+ * used after.
+ */
+static bool fib_stream_start(struct fib_session *sess,
+                             long long k,
+                             struct fib_result *r,
+                             size_t pos)
+{
+    char *stream = r->dec;
+
+    if (stream) {
+        r->dec = NULL;
+    } else {
+        stream = kvmalloc(r->size, GFP_KERNEL);
+        if (!stream)
+            return false;
+        memcpy(stream, r->out, r->size);
+    }
+    r->out = NULL;
+    fib_stream_hold(sess, k, r->format, stream, r->size, pos);
+    return true;
+}
+
+/*
+ * Next chunk of the stream held for F(k), -ENODATA if there is none. The
+ * stream ends with a read shorter than size or one that takes it whole
+ * from the start, a read elsewhere or one held in an older format than
+ * the file's drops it. A bad buffer gets -EFAULT and leaves the stream
+ * where it was.
+ */
+static ssize_t fib_stream_read(struct fib_session *sess,
+                               long long k,
+                               char *buf,
+                               size_t size)
+{
+    ssize_t ret = -ENODATA;
+
+    mutex_lock(&sess->stream_lock);
+    if (sess->stream &&
+        (sess->stream_k != k || sess->stream_format != sess->format)) {
+        fib_stream_stop(sess);
+    } else if (sess->stream) {
+        size_t pos = sess->stream_pos;
+        ktime_t kt = ktime_get();
+        ret = min(size, sess->stream_size - pos);
+        if (ret && copy_to_user(buf, sess->stream + pos, ret)) {
+            ret = -EFAULT;
+        } else {
+            fib_stats_copy(k, ret, ktime_to_ns(ktime_sub(ktime_get(), kt)));
+            sess->stream_pos += ret;
+        }
+        /*
+         * a short read already tells the reader the value is complete, and
+         * one that got it whole from the start was no chunked read at all
+         */
+        if (ret >= 0 &&
+            (ret < size || (!pos && sess->stream_pos == sess->stream_size)))
+            fib_stream_stop(sess);
+    }
+    mutex_unlock(&sess->stream_lock);
+    return ret;
+}
+
+/*
+ * calculate the fibonacci number at given offset. A result larger than
+ * the buffer is held, the following reads at the same offset return the
+ * rest in chunks until one comes back short, possibly with 0 bytes; one
+ * that fits is returned whole and nothing is held. Offsets fib_too_big
+ * rejects fail with EFBIG upfront.
+ */
 static ssize_t fib_read(struct file *file,
                         char *buf,
                         size_t size,
                         loff_t *offset)
 {
-    bn_t res = {};
-    bool doubling = false;
-#ifdef DOUBLING
-    doubling = true;
-#endif
-    kt = ktime_get();
-    ssize_t res_size;
-    if (doubling)
-        res_size = fib_doubling(*offset, &res) * sizeof(unsigned long long);
-    else
-        res_size = fib_sequence(*offset, &res) * sizeof(unsigned long long);
+    struct fib_session *sess = file->private_data;
+    if (fib_too_big(*offset))
+        return -EFBIG;
+
+    ssize_t res_size = fib_stream_read(sess, *offset, buf, size);
+    if (res_size != -ENODATA)
+        return res_size;
 
-    kt = ktime_sub(ktime_get(), kt);
-    if (res_size <= 0 || res_size > size) {
+    struct fib_result r;
+    res_size = fib_get(sess, *offset, READ_ONCE(sess->format), &r);
+
+    ktime_t k_to_ut = 0;
+    bool chunked = res_size > size;
+    if (res_size <= 0) {
         printk("read error:res_size = %ld\n", res_size);
-        return 0;
+        res_size = r.err;
+    } else {
+        res_size = min(res_size, (ssize_t) size);
+        access_ok(buf, size);
+        k_to_ut = ktime_get();
+        if (copy_to_user(buf, r.out, res_size))
+            res_size = -EFAULT;
+        k_to_ut = ktime_sub(ktime_get(), k_to_ut);
+        if (res_size > 0)
+            fib_stats_copy(*offset, res_size, ktime_to_ns(k_to_ut));
     }
-    access_ok(buf, size);
-    k_to_ut = ktime_get();
-    if (copy_to_user(buf, res.num, res_size))
-        res_size = 0;
-    k_to_ut = ktime_sub(ktime_get(), k_to_ut);
-    bn_free(&res);
+    /* only now, the stream may be dropped by another reader once held */
+    if (res_size > 0 && chunked && !fib_stream_start(sess, *offset, &r, size))
+        res_size = -ENOMEM;
+
+    fib_session_stats(sess, k_to_ut, &r);
+    fib_put(sess, *offset, &r);
     return res_size;
 }
 
-/* write operation is skipped */
+/* write reports on the last read of this file: offset 0 gives the compute
+ * time and 1 the copy time in ns, 2 the number of heap allocations, 3
+ * the time they took and 4 the time converting to the output format in ns.
+ * Threads sharing a file see each other's reads; the histograms over all
+ * requests are in debugfs.
+ */
 static ssize_t fib_write(struct file *file,
                          const char *buf,
                          size_t size,
                          loff_t *offset)
 {
+    struct fib_session *sess = file->private_data;
+    ssize_t ret = 0;
+
+    mutex_lock(&sess->lock);
     if (*offset == 0)
-        return ktime_to_ns(kt);
+        ret = ktime_to_ns(sess->kt);
     else if (*offset == 1)
-        return ktime_to_ns(k_to_ut);
+        ret = ktime_to_ns(sess->k_to_ut);
+    else if (*offset == 2)
+        ret = sess->allocs;
+    else if (*offset == 3)
+        ret = sess->alloc_ns;
+    else if (*offset == 4)
+        ret = ktime_to_ns(sess->dec_kt);
+    mutex_unlock(&sess->lock);
+    return ret;
+}
+
+/*
+ * FIB_IOC_RANGE: F(lo) and F(lo + 1) are computed once, every further
+ * value is one addition away.
+ */
+static long fib_range(struct fib_session *sess, struct fib_range *range)
+{
+    unsigned long long *out = u64_to_user_ptr(range->buf);
+    long ret = 0;
+
+    range->count = range->used = 0;
+    if (range->lo > range->hi)
+        return -EINVAL;
+    if (fib_too_big(range->hi))
+        return -EFBIG;
+
+    unsigned long long mem;
+    ret = fib_mem_get(range->hi, &mem);
+    if (ret)
+        return ret;
+    struct bn_arena local = {}, *arena = fib_arena_get(sess, &local, range->hi);
+    bn_t v[3] = {{.arena = arena}, {.arena = arena}, {.arena = arena}};
+    enum fib_algo algo;
+    ktime_t kt = ktime_get();
+    if (!fib_compute(range->lo, &v[0], &v[1], &algo))
+        ret = -ENOMEM;
+    else
+        fib_stats_compute(range->lo, algo, v[0].length,
+                          ktime_to_ns(ktime_sub(ktime_get(), kt)));
+    for (unsigned long long k = range->lo; !ret; k++) {
+        unsigned long long len = v[0].length;
+        if (range->used + sizeof(len) * (len + 1) > range->size) {
+            if (!range->count)
+                ret = -ENOSPC;
+            break;
+        }
+        if (put_user(len, out) ||
+            copy_to_user(out + 1, v[0].num, sizeof(len) * len)) {
+            ret = -EFAULT;
+            break;
+        }
+        out += len + 1;
+        range->used += sizeof(len) * (len + 1);
+        range->count++;
+        if (k == range->hi)
+            break;
+
+        if (!bn_add(&v[0], &v[1], &v[2])) {
+            ret = -ENOMEM;
+            break;
+        }
+        bn_swap(&v[0], &v[1]);
+        bn_swap(&v[1], &v[2]);
+        bn_shrink(&v[0]);
+        cond_resched();
+    }
+    for (int i = 0; i < 3; i++)
+        bn_free(&v[i]);
+    fib_arena_put(sess, arena);
+    fib_mem_put(mem);
+    return ret;
+}
+
+/*
+ * FIB_IOC_SIZE: the byte size of F(k). The value is held as a stream, so
+ * reading it right after costs no second computation.
+ */
+static long fib_size(struct fib_session *sess, __u64 *arg)
+{
+    struct fib_result r;
+    __u64 k;
+    long ret = 0;
+
+    if (get_user(k, arg))
+        return -EFAULT;
+    if (fib_too_big(k))
+        return -EFBIG;
+    if (!fib_get(sess, k, READ_ONCE(sess->format), &r) ||
+        !fib_stream_start(sess, k, &r, 0))
+        ret = r.err ? r.err : -ENOMEM;
+    else if (put_user(r.size, arg))
+        ret = -EFAULT;
+    fib_put(sess, k, &r);
+    return ret;
+}
+
+/* FIB_IOC_FORMAT: a value held in the old format is dropped */
+static long fib_format(struct fib_session *sess, __u32 *arg)
+{
+    __u32 format;
+
+    if (get_user(format, arg))
+        return -EFAULT;
+    if (format > FIB_FORMAT_DEC19)
+        return -EINVAL;
+    mutex_lock(&sess->stream_lock);
+    fib_stream_stop(sess);
+    WRITE_ONCE(sess->format, format);
+    mutex_unlock(&sess->stream_lock);
     return 0;
 }
 
+/* Submitted requests a file may have before FIB_IOC_REAP takes some */
+#define FIB_ASYNC_MAX 64
+
+/*
+ * Computes FIB_IOC_SUBMIT requests, as many at a time as there are CPUs
+ * over all files; the others wait queued rather than each holding their
+ * memory while waiting in fib_mem_get
+ */
+static struct workqueue_struct *fib_async_wq;
+
+/* A FIB_IOC_SUBMIT request, computed on fib_async_wq */
+struct fib_async {
+    struct work_struct work;
+    struct list_head node;
+    struct fib_session *sess;
+    long long k;
+    unsigned int format; /* the file's format when submitted */
+    char *out;           /* F(k) in format, NULL if memory ran out */
+    size_t size;
+};
+
+static void fib_async_work(struct work_struct *work)
+{
+    struct fib_async *req = container_of(work, struct fib_async, work);
+    struct fib_session *sess = req->sess;
+    struct fib_result r;
+
+    req->size = fib_get(sess, req->k, req->format, &r);
+    if (r.dec) {
+        /* a converted value is already a buffer of its own */
+        req->out = r.dec;
+        r.dec = NULL;
+    } else if (req->size && (req->out = kvmalloc(req->size, GFP_KERNEL))) {
+        memcpy(req->out, r.out, req->size);
+    }
+    fib_put(sess, req->k, &r);
+
+    mutex_lock(&sess->async_lock);
+    list_move_tail(&req->node, &sess->async_done);
+    mutex_unlock(&sess->async_lock);
+    wake_up_interruptible(&sess->async_wait);
+}
+
+/* FIB_IOC_SUBMIT: F(k) is computed in the background, poll tells when */
+static long fib_submit(struct fib_session *sess, __u64 *arg)
+{
+    struct fib_async *req;
+    __u64 k;
+
+    if (get_user(k, arg))
+        return -EFAULT;
+    if (fib_too_big(k))
+        return -EFBIG;
+    req = kzalloc(sizeof(*req), GFP_KERNEL);
+    if (!req)
+        return -ENOMEM;
+    INIT_WORK(&req->work, fib_async_work);
+    req->sess = sess;
+    req->k = k;
+    req->format = READ_ONCE(sess->format);
+
+    mutex_lock(&sess->async_lock);
+    if (sess->async_count == FIB_ASYNC_MAX) {
+        mutex_unlock(&sess->async_lock);
+        kfree(req);
+        return -EBUSY;
+    }
+    sess->async_count++;
+    list_add_tail(&req->node, &sess->async_pending);
+    mutex_unlock(&sess->async_lock);
+    queue_work(fib_async_wq, &req->work);
+    return 0;
+}
+
+/*
+ * FIB_IOC_REAP: the oldest finished request, held as the stream the next
+ * reads at its offset return
+ */
+static long fib_reap(struct fib_session *sess, struct fib_completion *arg)
+{
+    struct fib_completion done = {};
+    struct fib_async *req;
+
+    mutex_lock(&sess->async_lock);
+    req = list_first_entry_or_null(&sess->async_done, struct fib_async, node);
+    if (req) {
+        list_del(&req->node);
+        sess->async_count--;
+    }
+    mutex_unlock(&sess->async_lock);
+    if (!req)
+        return -EAGAIN;
+    /* its worker may still be waking pollers of sess */
+    flush_work(&req->work);
+
+    done.k = req->k;
+    if (req->out) {
+        done.size = req->size;
+        fib_stream_hold(sess, req->k, req->format, req->out, req->size, 0);
+    }
+    kfree(req);
+    return copy_to_user(arg, &done, sizeof(done)) ? -EFAULT : 0;
+}
+
+/*
+ * Waits for the running requests of sess, and for the workers of finished
+ * ones to let go of sess, and drops all of them
+ */
+static void fib_async_drain(struct fib_session *sess)
+{
+    struct fib_async *req, *tmp;
+
+    for (;;) {
+        mutex_lock(&sess->async_lock);
+        req = list_first_entry_or_null(&sess->async_pending,
+                                       struct fib_async, node);
+        mutex_unlock(&sess->async_lock);
+        if (!req)
+            break;
+        /* one that has started moves itself to async_done once finished */
+        if (cancel_work_sync(&req->work)) {
+            mutex_lock(&sess->async_lock);
+            list_del(&req->node);
+            mutex_unlock(&sess->async_lock);
+            kfree(req);
+        }
+    }
+    list_for_each_entry_safe (req, tmp, &sess->async_done, node) {
+        flush_work(&req->work);
+        kvfree(req->out);
+        kfree(req);
+    }
+}
+
+/* Readable while FIB_IOC_REAP has a finished request to hand out */
+static __poll_t fib_poll(struct file *file, poll_table *wait)
+{
+    struct fib_session *sess = file->private_data;
+    __poll_t mask = 0;
+
+    poll_wait(file, &sess->async_wait, wait);
+    mutex_lock(&sess->async_lock);
+    if (!list_empty(&sess->async_done))
+        mask = EPOLLIN | EPOLLRDNORM;
+    mutex_unlock(&sess->async_lock);
+    return mask;
+}
+
+static long fib_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct fib_session *sess = file->private_data;
+    struct fib_range range;
+    long ret;
+
+    switch (cmd) {
+    case FIB_IOC_RANGE:
+        if (copy_from_user(&range, (void *) arg, sizeof(range)))
+            return -EFAULT;
+        ret = fib_range(sess, &range);
+        if (copy_to_user((void *) arg, &range, sizeof(range)))
+            return -EFAULT;
+        return ret;
+    case FIB_IOC_SIZE:
+        return fib_size(sess, (__u64 *) arg);
+    case FIB_IOC_FORMAT:
+        return fib_format(sess, (__u32 *) arg);
+    case FIB_IOC_SUBMIT:
+        return fib_submit(sess, (__u64 *) arg);
+    case FIB_IOC_REAP:
+        return fib_reap(sess, (struct fib_completion *) arg);
+    }
+    return -ENOTTY;
+}
+
 static loff_t fib_device_lseek(struct file *file, loff_t offset, int orig)
 {
     loff_t new_pos = 0;
@@ -208,12 +1194,10 @@ static loff_t fib_device_lseek(struct file *file, loff_t offset, int orig)
         new_pos = file->f_pos + offset;
         break;
     case 2: /* SEEK_END: */
-        new_pos = MAX_LENGTH - offset;
+        new_pos = fib_max_offset() - offset;
         break;
     }
 
-    // if (new_pos > MAX_LENGTH)
-    //    new_pos = MAX_LENGTH;  // max case
     if (new_pos < 0)
         new_pos = 0;        // min case
     file->f_pos = new_pos;  // This is what we'll use now
@@ -227,13 +1211,25 @@ const struct file_operations fib_fops = {
     .open = fib_open,
     .release = fib_release,
     .llseek = fib_device_lseek,
+    .unlocked_ioctl = fib_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .poll = fib_poll,
 };
 
 static int __init init_fib_dev(void)
 {
     int rc = 0;
 
-    mutex_init(&fib_mutex);
+    bn_cpu_init();
+    /* before the device exists, so nothing multiplies meanwhile */
+    if (tune) {
+        bn_tune();
+        fib_auto_tune();
+    }
+    fib_async_wq = alloc_workqueue("fibonacci_async", WQ_UNBOUND,
+                                   num_online_cpus());
+    if (!fib_async_wq)
+        return -ENOMEM;
 
     // Let's register the device
     // This will dynamically allocate the major number
@@ -243,7 +1239,7 @@ static int __init init_fib_dev(void)
         printk(KERN_ALERT
                "Failed to register the fibonacci char device. rc = %i",
                rc);
-        return rc;
+        goto failed_region;
     }
 
     fib_cdev = cdev_alloc();
@@ -274,6 +1270,15 @@ static int __init init_fib_dev(void)
         rc = -4;
         goto failed_device_create;
     }
+    fib_stats_init();
+    fib_debugfs = debugfs_create_dir(DEV_FIBONACCI_NAME, NULL);
+    fib_cache_debugfs(fib_debugfs);
+    fib_checkpoint_debugfs(fib_debugfs);
+    fib_stats_debugfs(fib_debugfs);
+    bn_debugfs(fib_debugfs);
+    debugfs_create_file("engines", 0444, fib_debugfs, NULL, &fib_engines_fops);
+    /* without it every product simply stays on the reading CPU */
+    bn_workqueue_init(DEV_FIBONACCI_NAME);
     return rc;
 failed_device_create:
     class_destroy(fib_class);
@@ -281,16 +1286,24 @@ failed_class_create:
     cdev_del(fib_cdev);
 failed_cdev:
     unregister_chrdev_region(fib_dev, 1);
+failed_region:
+    destroy_workqueue(fib_async_wq);
     return rc;
 }
 
 static void __exit exit_fib_dev(void)
 {
-    mutex_destroy(&fib_mutex);
+    debugfs_remove_recursive(fib_debugfs);
+    fib_cache_clear();
+    fib_checkpoint_clear();
+    bn_dec_clear();
+    bn_workqueue_exit();
+    fib_stats_exit();
     device_destroy(fib_class, fib_dev);
     class_destroy(fib_class);
     cdev_del(fib_cdev);
     unregister_chrdev_region(fib_dev, 1);
+    destroy_workqueue(fib_async_wq);
 }
 
 module_init(init_fib_dev);
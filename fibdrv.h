@@ -0,0 +1,70 @@
+#ifndef _FIBDRV_H
+#define _FIBDRV_H
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*
+ * Interface of /dev/fibonacci shared with user space. Offsets are 64 bit;
+ * reads and commands for an F(k) too large to compute in the memory
+ * available fail with EFBIG before any work is done. One that fits only
+ * once other computations finish waits for them.
+ *
+ * FIB_IOC_RANGE fills buf with F(lo), F(lo + 1), ..., F(hi), each one as
+ * a __u64 limb count followed by that many little-endian 64-bit limbs.
+ * Values that do not fit in size bytes are left out; count and used tell
+ * how many values and bytes were written, so a caller can continue from
+ * lo + count. Fails with ENOSPC only if not even F(lo) fits.
+ *
+ * FIB_IOC_SIZE takes k and returns the byte size of F(k) in its place.
+ *
+ * A read at offset k whose buffer F(k) does not fit is the first chunk of
+ * it; the following reads at k return the rest until one comes back
+ * shorter than its buffer, possibly empty. A buffer that F(k) fits, even
+ * exactly, gets it whole and the next read at k starts over, so a reader
+ * going in chunks should learn the size from FIB_IOC_SIZE first. After
+ * FIB_IOC_SIZE the value is already held and the first read at k costs no
+ * computation. Reading in chunks is also how to take a value too large
+ * for one user buffer.
+ *
+ * FIB_IOC_FORMAT sets what reads and FIB_IOC_SIZE of the file return:
+ * FIB_FORMAT_BINARY limbs as above, FIB_FORMAT_DECIMAL ASCII digits, most
+ * significant first, without sign or terminator, or FIB_FORMAT_DEC19 __u64
+ * digits in base 10^19, most significant first, the first one nonzero
+ * unless the value is 0. FIB_IOC_RANGE always returns limbs.
+ *
+ * FIB_IOC_SUBMIT takes k and computes F(k) in the background, in the
+ * format the file has at that moment; a file has at most 64 requests not
+ * yet reaped, EBUSY tells to reap first. poll reports the file readable
+ * while a request has finished. FIB_IOC_REAP takes the oldest finished
+ * one, or fails with EAGAIN, and fills in its k and byte size, 0 if memory
+ * ran out. The value is then held as for FIB_IOC_SIZE, so reads at k
+ * return it without blocking, unless FIB_IOC_FORMAT has changed the
+ * format since.
+ */
+struct fib_range {
+    __u64 lo;
+    __u64 hi;
+    __u64 buf;
+    __u64 size;
+    __u64 count;
+    __u64 used;
+};
+
+struct fib_completion {
+    __u64 k;
+    __u64 size;
+};
+
+#define FIB_IOC_MAGIC 'f'
+#define FIB_IOC_RANGE _IOWR(FIB_IOC_MAGIC, 1, struct fib_range)
+#define FIB_IOC_SIZE _IOWR(FIB_IOC_MAGIC, 2, __u64)
+/* 3 was FIB_IOC_COMPUTE, left unused */
+#define FIB_IOC_FORMAT _IOW(FIB_IOC_MAGIC, 4, __u32)
+#define FIB_IOC_SUBMIT _IOW(FIB_IOC_MAGIC, 5, __u64)
+#define FIB_IOC_REAP _IOR(FIB_IOC_MAGIC, 6, struct fib_completion)
+
+#define FIB_FORMAT_BINARY 0
+#define FIB_FORMAT_DECIMAL 1
+#define FIB_FORMAT_DEC19 2
+
+#endif /* _FIBDRV_H */
@@ -0,0 +1,51 @@
+#!/bin/sh
+# Speedup of one large read against the number of CPUs the driver may
+# spread its products over. Run as root with the module loaded and bench
+# built: scripts/parallel.sh [offset] [reads]
+
+offset=${1:-10000000}
+reads=${2:-5}
+params=/sys/module/fibdrv_new/parameters
+cpumask=/sys/devices/virtual/workqueue/fibonacci/cpumask
+
+if ! test -w "$cpumask" || ! test -x ./bench; then
+    echo "Load fibdrv_new, build bench and run scripts/parallel.sh as root."
+    exit 1
+fi
+
+# every read computes from scratch, not from the cache, cursor or checkpoints
+saved_mask=$(cat $cpumask)
+saved_threshold=$(cat $params/parallel_threshold)
+saved="cache_size=$(cat $params/cache_size)
+checkpoint_gap=$(cat $params/checkpoint_gap)
+use_cursor=$(cat $params/use_cursor)"
+echo 0 > $params/cache_size
+echo 0 > $params/checkpoint_gap
+echo N > $params/use_cursor
+
+# kernel us per read on CPUs 0..n-1, the reader included
+kernel_us() {
+    printf '%x' $(((1 << $1) - 1)) > $cpumask
+    taskset -c 0-$(($1 - 1)) ./bench "$offset" "$reads" 1 | tail -n 1 |
+        cut -d ' ' -f 4
+}
+
+cpus=$(nproc)
+test "$cpus" -gt 31 && cpus=31
+echo 0 > $params/parallel_threshold
+serial=$(kernel_us 1)
+echo "$saved_threshold" > $params/parallel_threshold
+
+echo "# offset $offset, serial $serial us per read"
+echo "# cpus kernel-us/read speedup"
+n=1
+while test $n -le "$cpus"; do
+    us=$(kernel_us $n)
+    echo "$n $us $(echo "$serial / $us" | bc -l | cut -c 1-4)"
+    n=$((n + 1))
+done
+
+echo "$saved_mask" > $cpumask
+for p in $saved; do
+    echo "${p#*=}" > "$params/${p%%=*}"
+done
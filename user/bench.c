@@ -0,0 +1,147 @@
+/*
+ * Microbenchmarks of bn.c and the engines in user space: the best ns per
+ * call of add, sub, lshift, mult and sqr across operand sizes, then of
+ * every engine across k. Usage: bench [name], to run only the lines whose
+ * operation starts with name.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "bn.h"
+#include "fib_engine.h"
+
+/* Calls are repeated for at least this long, best of BENCH_ROUNDS */
+#define BENCH_NS 20000000
+#define BENCH_ROUNDS 3
+
+static const unsigned long long bench_limbs[] = {
+    1, 4, 16, 64, 256, 1024, 4096, 16384, 65536,
+};
+
+static const long long bench_k[] = {
+    100, 1000, 10000, 100000, 1000000, 10000000,
+};
+
+enum bench_op { BENCH_ADD, BENCH_SUB, BENCH_LSHIFT, BENCH_MULT, BENCH_SQR };
+
+static const char *const bench_names[] = {"add", "sub", "lshift", "mult",
+                                          "sqr"};
+
+static const struct {
+    const char *name;
+    unsigned long long (*fn)(long long k, bn_t *ret, bn_t *next);
+    long long max_k; /* beyond it the engine takes too long to bother */
+} bench_engines[] = {
+    {"fib_sequence", fib_sequence, 100000},
+    {"fib_doubling", fib_doubling, 10000000},
+    {"fib_lucas", fib_lucas, 10000000},
+};
+
+static void bn_random(bn_t *r, unsigned long long n)
+{
+    bn_new(r, n);
+    get_random_bytes(r->num, sizeof(unsigned long long) * n);
+    r->num[n - 1] |= 1ULL << 62; /* no carry out of an addition */
+}
+
+static bool bench_run(enum bench_op op, bn_t *a, bn_t *b, bn_t *r)
+{
+    switch (op) {
+    case BENCH_ADD:
+        return bn_add(a, b, r);
+    case BENCH_SUB:
+        return bn_sub(a, b, r);
+    case BENCH_LSHIFT:
+        /* shifting a copy keeps the operand the same size every time */
+        return bn_copy(r, a) && bn_lshift(r, 17);
+    case BENCH_MULT:
+        return bn_copy(r, b) && bn_mult(a, r);
+    case BENCH_SQR:
+        return bn_copy(r, a) && bn_sqr(r);
+    }
+    return false;
+}
+
+static void bench_op(enum bench_op op, unsigned long long n)
+{
+    bn_t a = {}, b = {}, r = {};
+    u64 best = U64_MAX;
+
+    bn_random(&a, n);
+    bn_random(&b, n);
+    b.num[n - 1] >>= 1; /* a > b for bn_sub */
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        unsigned long long reps = 0;
+        ktime_t kt = ktime_get(), t;
+        do {
+            if (!bench_run(op, &a, &b, &r)) {
+                printf("%s %llu out of memory\n", bench_names[op], n);
+                goto out;
+            }
+            reps++;
+            t = ktime_sub(ktime_get(), kt);
+        } while (ktime_to_ns(t) < BENCH_NS);
+        best = min(best, (u64) ktime_to_ns(t) / reps);
+    }
+    printf("%s %llu %llu\n", bench_names[op], n, (unsigned long long) best);
+out:
+    bn_free(&a);
+    bn_free(&b);
+    bn_free(&r);
+}
+
+static void bench_engine(int i, long long k)
+{
+    u64 best = U64_MAX;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        bn_t f = {};
+        ktime_t kt = ktime_get();
+        bool ok = bench_engines[i].fn(k, &f, NULL);
+        kt = ktime_sub(ktime_get(), kt);
+        bn_free(&f);
+        if (!ok) {
+            printf("%s %lld out of memory\n", bench_engines[i].name, k);
+            return;
+        }
+        best = min(best, (u64) ktime_to_ns(kt));
+    }
+    printf("%s %lld %llu\n", bench_engines[i].name, k,
+           (unsigned long long) best);
+}
+
+static bool bench_wanted(const char *name, const char *filter)
+{
+    return !filter || !strncmp(name, filter, strlen(filter));
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = argc > 1 ? argv[1] : NULL;
+
+    bn_cpu_init();
+    bn_workqueue_init("bench");
+    printf("# karatsuba %u toom3 %u ntt %u parallel %u\n",
+           bn_karatsuba_threshold, bn_toom3_threshold, bn_ntt_threshold,
+           bn_parallel_threshold);
+
+    printf("# op limbs ns\n");
+    for (int op = 0; op < ARRAY_SIZE(bench_names); op++) {
+        if (!bench_wanted(bench_names[op], filter))
+            continue;
+        for (int j = 0; j < ARRAY_SIZE(bench_limbs); j++)
+            bench_op(op, bench_limbs[j]);
+    }
+
+    printf("# engine k ns\n");
+    for (int i = 0; i < ARRAY_SIZE(bench_engines); i++) {
+        if (!bench_wanted(bench_engines[i].name, filter))
+            continue;
+        for (int j = 0; j < ARRAY_SIZE(bench_k); j++) {
+            if (bench_k[j] <= bench_engines[i].max_k)
+                bench_engine(i, bench_k[j]);
+        }
+    }
+    bn_workqueue_exit();
+    return 0;
+}
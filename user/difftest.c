@@ -0,0 +1,288 @@
+/*
+ * Randomized differential test of bn.c, bn_dec.c and the engines against
+ * GMP. Every round draws new multiplication and parallel thresholds, so
+ * small operands go through Karatsuba, Toom-3, the NTT and the workqueue
+ * as well. Usage: difftest [rounds] [seed]
+ */
+#include <gmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bn.h"
+#include "bn_dec.h"
+#include "fib_engine.h"
+
+static gmp_randstate_t rng;
+static unsigned long round_no;
+static int failures;
+
+static unsigned long rnd(unsigned long n)
+{
+    return gmp_urandomm_ui(rng, n);
+}
+
+/* Mostly short operands, with the odd one long enough for the NTT */
+static unsigned long rnd_limbs(void)
+{
+    switch (rnd(8)) {
+    case 0:
+        return 1 + rnd(2000);
+    case 1:
+    case 2:
+        return 1 + rnd(300);
+    default:
+        return 1 + rnd(40);
+    }
+}
+
+/* Long runs of ones and zeros, which is where carries go wrong */
+static void rnd_mpz(mpz_t z, unsigned long limbs)
+{
+    mpz_rrandomb(z, rng, limbs * 64 - rnd(64));
+}
+
+static bool bn_set_mpz(bn_t *r, const mpz_t z)
+{
+    size_t n = mpz_size(z);
+
+    if (!bn_zrenew(r, n ? n : 1))
+        return false;
+    mpz_export(r->num, NULL, -1, sizeof(unsigned long long), 0, 0, z);
+    return true;
+}
+
+static void mpz_set_bn(mpz_t z, const bn_t *r)
+{
+    mpz_import(z, r->length, -1, sizeof(unsigned long long), 0, 0, r->num);
+}
+
+static void check(const char *op, const bn_t *r, const mpz_t want)
+{
+    mpz_t got;
+
+    mpz_init(got);
+    mpz_set_bn(got, r);
+    if (mpz_cmp(got, want)) {
+        gmp_printf("round %lu: %s is wrong, %zu limbs instead of %zu\n",
+                   round_no, op, mpz_size(got), mpz_size(want));
+        failures++;
+    }
+    mpz_clear(got);
+}
+
+static void fail(const char *op)
+{
+    printf("round %lu: %s ran out of memory\n", round_no, op);
+    failures++;
+}
+
+static void test_add_sub(struct bn_arena *arena)
+{
+    bn_t a = {.arena = arena}, b = {.arena = arena}, r = {.arena = arena};
+    mpz_t x, y, z;
+
+    mpz_inits(x, y, z, NULL);
+    rnd_mpz(x, rnd_limbs());
+    rnd_mpz(y, rnd(2) ? rnd_limbs() : mpz_size(x));
+    if (mpz_cmp(x, y) < 0)
+        mpz_swap(x, y);
+    if (!bn_set_mpz(&a, x) || !bn_set_mpz(&b, y)) {
+        fail("set");
+        goto out;
+    }
+
+    mpz_add(z, x, y);
+    if (bn_add(&a, &b, &r))
+        check("add", &r, z);
+    else
+        fail("add");
+    mpz_sub(z, x, y);
+    if (bn_sub(&a, &b, &r))
+        check("sub", &r, z);
+    else
+        fail("sub");
+
+    unsigned long long v = rnd(2) ? ~0ULL - rnd(4) : rnd(1000);
+    mpz_add_ui(z, x, v);
+    if (bn_copy(&r, &a) && bn_add_u64(&r, v))
+        check("add_u64", &r, z);
+    else
+        fail("add_u64");
+    if (mpz_cmp_ui(x, v) >= 0) {
+        mpz_sub_ui(z, x, v);
+        if (bn_copy(&r, &a)) {
+            bn_sub_u64(&r, v);
+            check("sub_u64", &r, z);
+        } else {
+            fail("sub_u64");
+        }
+    }
+out:
+    bn_free(&a);
+    bn_free(&b);
+    bn_free(&r);
+    mpz_clears(x, y, z, NULL);
+}
+
+static void test_shift(struct bn_arena *arena)
+{
+    bn_t a = {.arena = arena};
+    mpz_t x, z;
+    unsigned long limbs = rnd_limbs();
+    unsigned long long bits = rnd(2) ? rnd(64) : rnd(64 * (limbs + 1));
+
+    mpz_inits(x, z, NULL);
+    rnd_mpz(x, limbs);
+    mpz_mul_2exp(z, x, bits);
+    if (bn_set_mpz(&a, x) && bn_lshift(&a, bits))
+        check("lshift", &a, z);
+    else
+        fail("lshift");
+
+    mpz_fdiv_q_2exp(z, x, bits);
+    if (bn_set_mpz(&a, x)) {
+        bn_rshift(&a, bits);
+        check("rshift", &a, z);
+    } else {
+        fail("rshift");
+    }
+    bn_free(&a);
+    mpz_clears(x, z, NULL);
+}
+
+static void test_mult(struct bn_arena *arena)
+{
+    bn_t a = {.arena = arena}, r = {.arena = arena};
+    mpz_t x, y, z;
+    unsigned long limbs = rnd_limbs();
+
+    mpz_inits(x, y, z, NULL);
+    rnd_mpz(x, limbs);
+    rnd_mpz(y, rnd(4) ? limbs : rnd_limbs());
+
+    mpz_mul(z, x, y);
+    if (bn_set_mpz(&a, x) && bn_set_mpz(&r, y) && bn_mult(&a, &r))
+        check("mult", &r, z);
+    else
+        fail("mult");
+
+    mpz_mul(z, x, x);
+    if (bn_set_mpz(&r, x) && bn_sqr(&r))
+        check("sqr", &r, z);
+    else
+        fail("sqr");
+
+    bn_free(&a);
+    bn_free(&r);
+    mpz_clears(x, y, z, NULL);
+}
+
+static void test_dec(void)
+{
+    bn_t a = {};
+    mpz_t x;
+    size_t size;
+
+    mpz_init(x);
+    rnd_mpz(x, rnd_limbs());
+    if (!bn_set_mpz(&a, x)) {
+        fail("dec");
+        goto out;
+    }
+    char *dec = bn_dec(a.num, a.length, &size);
+    char *want = mpz_get_str(NULL, 10, x);
+    if (!dec) {
+        fail("dec");
+    } else if (size != strlen(want) || memcmp(dec, want, size)) {
+        printf("round %lu: dec is wrong, %zu digits instead of %zu\n",
+               round_no, size, strlen(want));
+        failures++;
+    }
+    kvfree(dec);
+    free(want);
+out:
+    bn_free(&a);
+    mpz_clear(x);
+}
+
+static void test_engines(struct bn_arena *arena)
+{
+    static unsigned long long (*const engines[])(long long, bn_t *, bn_t *) = {
+        fib_sequence,
+        fib_doubling,
+        fib_lucas,
+    };
+    static const char *const names[] = {"fib_sequence", "fib_doubling",
+                                        "fib_lucas"};
+    long long k = rnd(4) ? rnd(5000) : rnd(300000);
+    mpz_t want, prev, succ;
+
+    mpz_inits(want, prev, succ, NULL);
+    mpz_fib2_ui(want, prev, k);
+    mpz_add(succ, want, prev);
+    for (int i = 0; i < 3; i++) {
+        bn_t f = {.arena = arena}, g = {.arena = arena};
+        bool next = rnd(2);
+        if (i == 0 && k > 20000)
+            continue;
+        if (engines[i](k, &f, next ? &g : NULL)) {
+            check(names[i], &f, want);
+            if (next)
+                check(names[i], &g, succ);
+        } else {
+            fail(names[i]);
+        }
+        bn_free(&f);
+        bn_free(&g);
+    }
+
+    bn_t a = {.arena = arena}, b = {.arena = arena};
+    if (k && fib_lucas_pair(k, &a, &b)) {
+        check("fib_lucas_pair", &a, want);
+        check("fib_lucas_pair", &b, prev);
+    } else if (k) {
+        fail("fib_lucas_pair");
+    }
+    bn_free(&a);
+    bn_free(&b);
+    mpz_clears(want, prev, succ, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long rounds = argc > 1 ? strtoul(argv[1], NULL, 0) : 2000;
+    unsigned long seed = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+
+    gmp_randinit_default(rng);
+    gmp_randseed_ui(rng, seed);
+    srandom(seed);
+    bn_cpu_init();
+    bn_workqueue_init("difftest");
+
+    for (round_no = 0; round_no < rounds && failures < 10; round_no++) {
+        struct bn_arena arena = {}, *ap = NULL;
+
+        bn_karatsuba_threshold = 8 + rnd(64);
+        bn_toom3_threshold = 48 + rnd(400);
+        bn_ntt_threshold = rnd(4) ? BN_NTT_THRESHOLD : 8 + rnd(2000);
+        bn_parallel_threshold = rnd(4) ? 0 : 8 + rnd(2000);
+        if (rnd(2) && bn_arena_reserve(&arena, 1 + rnd(1000), 1 + rnd(8)))
+            ap = &arena;
+
+        test_add_sub(ap);
+        test_shift(ap);
+        test_mult(ap);
+        if (round_no % 8 == 0)
+            test_dec();
+        if (round_no % 16 == 0)
+            test_engines(ap);
+        bn_arena_release(&arena);
+    }
+
+    bn_workqueue_exit();
+    bn_dec_clear();
+    gmp_randclear(rng);
+    printf("%lu rounds, seed %lu: %s\n", round_no, seed,
+           failures ? "FAILED" : "ok");
+    return failures != 0;
+}
@@ -0,0 +1,375 @@
+/*
+ * Randomized test of the driver against GMP. fibdrv.c is built into this
+ * program with the cache, checkpoints and statistics and driven through
+ * its file operations, so the table, cursor stepping, the cache,
+ * checkpoint seeding, chunked and exact-fit reads, FIB_IOC_RANGE and
+ * background requests are all checked, each round under another
+ * combination of use_cursor, cache_size, checkpoint_gap, engine and output
+ * format. fib_get is called directly where it matters which way F(k) was
+ * obtained. Usage: drvtest [rounds] [seed]
+ */
+#include <gmp.h>
+#include <sched.h>
+
+#include "fibdrv.c"
+
+static gmp_randstate_t rng;
+static unsigned long round_no;
+static int failures;
+
+static unsigned long rnd(unsigned long n)
+{
+    return gmp_urandomm_ui(rng, n);
+}
+
+static const char *const format_names[] = {"binary", "decimal", "dec19"};
+
+/* What the driver returns for F(k) in format, size bytes */
+static char *expect(long long k, unsigned int format, size_t *size)
+{
+    mpz_t f;
+    char *out;
+
+    mpz_init(f);
+    mpz_fib_ui(f, k);
+    if (format == FIB_FORMAT_BINARY) {
+        size_t n = mpz_size(f) ? mpz_size(f) : 1;
+        *size = n * sizeof(unsigned long long);
+        out = calloc(n, sizeof(unsigned long long));
+        mpz_export(out, NULL, -1, sizeof(unsigned long long), 0, 0, f);
+    } else if (format == FIB_FORMAT_DECIMAL) {
+        out = mpz_get_str(NULL, 10, f);
+        *size = strlen(out);
+    } else {
+        /* base 10^19 digits, most significant first */
+        size_t n = mpz_sizeinbase(f, 10) / 19 + 1;
+        unsigned long long *d = calloc(n, sizeof(*d));
+        size_t i = n;
+        do
+            d[--i] = mpz_tdiv_q_ui(f, f, 10000000000000000000UL);
+        while (mpz_sgn(f));
+        memmove(d, d + i, (n - i) * sizeof(*d));
+        *size = (n - i) * sizeof(*d);
+        out = (char *) d;
+    }
+    mpz_clear(f);
+    return out;
+}
+
+static void check(const char *op,
+                  long long k,
+                  unsigned int format,
+                  const void *got,
+                  ssize_t size)
+{
+    size_t want_size;
+    char *want = expect(k, format, &want_size);
+
+    if (size != (ssize_t) want_size || memcmp(got, want, want_size)) {
+        printf("round %lu: %s of F(%lld) as %s is wrong, %zd bytes "
+               "instead of %zu\n",
+               round_no, op, k, format_names[format], size, want_size);
+        failures++;
+    }
+    free(want);
+}
+
+static void check_algo(const char *op,
+                       long long k,
+                       enum fib_algo got,
+                       enum fib_algo want)
+{
+    if (got != want) {
+        printf("round %lu: %s of F(%lld) came from algo %d instead of %d\n",
+               round_no, op, k, got, want);
+        failures++;
+    }
+}
+
+static void set_format(struct file *file, unsigned int format)
+{
+    __u32 arg = format;
+
+    fib_fops.unlocked_ioctl(file, FIB_IOC_FORMAT, (unsigned long) &arg);
+}
+
+/*
+ * F(k) read in chunk byte reads, the way fibdrv.h describes: until a read
+ * comes back short, or with one read when size, the value's size learned
+ * beforehand, fits the buffer
+ */
+static ssize_t read_value(struct file *file,
+                          long long k,
+                          char *buf,
+                          size_t chunk,
+                          size_t size)
+{
+    ssize_t total = 0, ret;
+
+    do {
+        loff_t pos = k;
+        ret = fib_fops.read(file, buf + total, chunk, &pos);
+        if (ret < 0)
+            return ret;
+        total += ret;
+    } while (ret == chunk && size > chunk);
+    return total;
+}
+
+/* F(k) through fib_get, checking where it came from */
+static void get_via(struct file *file, long long k, enum fib_algo want)
+{
+    struct fib_session *sess = file->private_data;
+    struct fib_result r;
+    size_t size = fib_get(sess, k, FIB_FORMAT_BINARY, &r);
+
+    check("fib_get", k, FIB_FORMAT_BINARY, r.out, size);
+    check_algo("fib_get", k, r.algo, want);
+    fib_put(sess, k, &r);
+}
+
+/* The engine fib_compute runs for k without a checkpoint */
+static enum fib_algo engine_algo(long long k)
+{
+    return FIB_ALGO_SEQUENCE + fib_engine_pick(k);
+}
+
+/* Every way fib_get_limbs has of getting F(k), each forced in turn */
+static void test_paths(void)
+{
+    struct inode inode = {};
+    struct file file = {};
+    long long k = 1000 + rnd(50000);
+
+    fib_fops.open(&inode, &file);
+    for (long long i = 0; i <= FIB_SMALL_MAX; i++)
+        get_via(&file, i, FIB_ALGO_TABLE);
+
+    use_cursor = true;
+    fib_cache_size = 0;
+    fib_checkpoint_gap = 0;
+    get_via(&file, k, engine_algo(k));
+    get_via(&file, k, FIB_ALGO_CURSOR);
+    get_via(&file, k + 1, FIB_ALGO_CURSOR);
+    get_via(&file, k + 1 + FIB_CURSOR_STEPS, FIB_ALGO_CURSOR);
+    get_via(&file, k, engine_algo(k));
+    get_via(&file, k + 2 + FIB_CURSOR_STEPS,
+            engine_algo(k + 2 + FIB_CURSOR_STEPS));
+    /* too large a value to keep a cursor on */
+    long long big = k;
+    while (3 * fib_limbs(big) <= FIB_ARENA_KEEP)
+        big *= 2;
+    get_via(&file, big, engine_algo(big));
+    get_via(&file, big + 1, engine_algo(big + 1));
+
+    use_cursor = false;
+    fib_cache_size = 4096;
+    get_via(&file, k, engine_algo(k));
+    get_via(&file, k, FIB_ALGO_CACHE);
+    fib_cache_size = 0;
+    get_via(&file, k, engine_algo(k));
+
+    fib_checkpoint_gap = 1024;
+    fib_checkpoint_clear();
+    k += FIB_CHECKPOINT_MIN;
+    get_via(&file, k, engine_algo(k));
+    /* well within the k/8 a checkpoint reaches */
+    get_via(&file, k + k / 16, FIB_ALGO_CHECKPOINT);
+    fib_checkpoint_gap = 0;
+    get_via(&file, k + 1, engine_algo(k + 1));
+
+    for (int i = 0; i < ARRAY_SIZE(fib_engines); i++) {
+        fib_engine_set(fib_engines[i].name, NULL);
+        get_via(&file, k, FIB_ALGO_SEQUENCE + i);
+    }
+    fib_engine_set("auto", NULL);
+    fib_fops.release(&inode, &file);
+}
+
+/* Chunked reads, exact fits and streams dropped halfway */
+static void test_stream(struct file *file,
+                        long long k,
+                        unsigned int format,
+                        char *buf)
+{
+    size_t size;
+    free(expect(k, format, &size));
+    __u64 arg = k;
+
+    /* which leaves the value held for the first read */
+    if (rnd(2) &&
+        (fib_fops.unlocked_ioctl(file, FIB_IOC_SIZE, (unsigned long) &arg) ||
+         arg != size)) {
+        printf("round %lu: FIB_IOC_SIZE of F(%lld) is %llu, not %zu\n",
+               round_no, k, (unsigned long long) arg, size);
+        failures++;
+    }
+    size_t chunk = 1 + rnd(size + 16);
+    if (rnd(4) == 0)
+        chunk = size;
+    else if (rnd(4) == 0)
+        chunk = size / (1 + rnd(4)) + 1;
+    check("read", k, format, buf, read_value(file, k, buf, chunk, size));
+    /* a finished read leaves nothing behind, the next one starts over */
+    check("read again", k, format, buf,
+          read_value(file, k, buf, chunk, size));
+
+    /* one chunk, then a read elsewhere, then the whole value again */
+    if (size > 1) {
+        loff_t pos = k;
+        fib_fops.read(file, buf, size - 1, &pos);
+        pos = rnd(FIB_SMALL_MAX);
+        fib_fops.read(file, buf, sizeof(unsigned long long), &pos);
+        check("read after a dropped stream", k, format, buf,
+              read_value(file, k, buf, size, size));
+    }
+}
+
+static void test_range(struct file *file, long long lo)
+{
+    long long hi = lo + rnd(300);
+    size_t size = sizeof(unsigned long long) * (hi - lo + 1) *
+                  (2 + fib_limbs(hi));
+    unsigned long long *buf = malloc(size), *p = buf;
+    struct fib_range range = {
+        .lo = lo,
+        .hi = hi,
+        .buf = (uintptr_t) buf,
+        .size = size,
+    };
+
+    if (fib_fops.unlocked_ioctl(file, FIB_IOC_RANGE, (unsigned long) &range) ||
+        range.count != hi - lo + 1) {
+        printf("round %lu: FIB_IOC_RANGE F(%lld)..F(%lld) returned %llu\n",
+               round_no, lo, hi, (unsigned long long) range.count);
+        failures++;
+        range.count = 0;
+    }
+    for (unsigned long long i = 0; i < range.count; i++) {
+        check("FIB_IOC_RANGE", lo + i, FIB_FORMAT_BINARY, p + 1,
+              p[0] * sizeof(*p));
+        p += p[0] + 1;
+    }
+    free(buf);
+}
+
+/*
+ * A request is computed in the format the file had when it was submitted,
+ * reads after the format changed meanwhile get the new one
+ */
+static void test_async(struct file *file, long long k, char *buf)
+{
+    struct fib_session *sess = file->private_data;
+    unsigned int format = sess->format;
+    struct fib_completion done;
+    __u64 arg = k;
+    size_t size;
+
+    free(expect(k, format, &size));
+    fib_fops.unlocked_ioctl(file, FIB_IOC_SUBMIT, (unsigned long) &arg);
+    if (rnd(2)) {
+        format = rnd(3);
+        set_format(file, format);
+    }
+    while (!(fib_fops.poll(file, NULL) & EPOLLIN))
+        sched_yield();
+    if (fib_fops.unlocked_ioctl(file, FIB_IOC_REAP, (unsigned long) &done) ||
+        done.k != k || done.size != size) {
+        printf("round %lu: FIB_IOC_REAP of F(%lld) returned %llu bytes "
+               "instead of %zu\n",
+               round_no, k, (unsigned long long) done.size, size);
+        failures++;
+        return;
+    }
+    free(expect(k, format, &size));
+    check("FIB_IOC_REAP", k, format, buf,
+          read_value(file, k, buf, size, size));
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long rounds = argc > 1 ? strtoul(argv[1], NULL, 0) : 100;
+    unsigned long seed = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+    static const char *const engines[] = {"sequence", "doubling", "lucas",
+                                          "auto"};
+    static const unsigned int gaps[] = {0, 64, 1024};
+    char *buf = malloc(1 << 20);
+
+    gmp_randinit_default(rng);
+    gmp_randseed_ui(rng, seed);
+    srandom(seed);
+    tune = false;
+    if (init_fib_dev())
+        return 1;
+
+    test_paths();
+    for (round_no = 0; round_no < rounds && failures < 10; round_no++) {
+        struct inode inode = {};
+        struct file file = {};
+        const char *engine = engines[rnd(ARRAY_SIZE(engines))];
+        /* fib_sequence is quadratic, keep it to short values */
+        long long max = strcmp(engine, "sequence") ? 200000 : 20000;
+        long long k = rnd(max);
+
+        use_cursor = rnd(2);
+        fib_cache_size = rnd(2) ? 4096 : rnd(64);
+        fib_checkpoint_gap = gaps[rnd(ARRAY_SIZE(gaps))];
+        fib_engine_set(engine, NULL);
+        fib_fops.open(&inode, &file);
+        for (int i = 0; i < 16; i++) {
+            unsigned int format = rnd(3);
+
+            set_format(&file, format);
+            switch (rnd(8)) {
+            case 0:
+                k = rnd(FIB_SMALL_MAX + 1);
+                break;
+            case 1:
+                k = rnd(max);
+                break;
+            case 2:
+                k -= rnd(k + 1);
+                break;
+            case 3:
+                k += k / (1 + rnd(8));
+                break;
+            case 4:
+                k += rnd(2 * FIB_CURSOR_STEPS);
+                break;
+            default:
+                k += rnd(2);
+                break;
+            }
+            k %= max;
+            switch (rnd(5)) {
+            case 0:
+                test_range(&file, k);
+                break;
+            case 1:
+                test_async(&file, k, buf);
+                break;
+            default:
+                test_stream(&file, k, format, buf);
+                break;
+            }
+        }
+        fib_fops.release(&inode, &file);
+    }
+
+    loff_t pos = 1LL << 62;
+    struct inode inode = {};
+    struct file file = {};
+    fib_fops.open(&inode, &file);
+    if (fib_fops.read(&file, buf, 8, &pos) != -EFBIG) {
+        printf("F(2^62) did not fail with EFBIG\n");
+        failures++;
+    }
+    fib_fops.release(&inode, &file);
+
+    exit_fib_dev();
+    gmp_randclear(rng);
+    free(buf);
+    printf("%lu rounds, seed %lu: %s\n", round_no, seed,
+           failures ? "FAILED" : "ok");
+    return failures != 0;
+}
@@ -0,0 +1,186 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "kernel.h"
+
+ktime_t ktime_get(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void get_random_bytes(void *buf, size_t len)
+{
+    unsigned char *p = buf;
+
+    for (size_t i = 0; i < len; i++)
+        p[i] = random();
+}
+
+unsigned int num_online_cpus(void)
+{
+    return sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+struct workqueue_struct *alloc_workqueue(const char *fmt,
+                                         unsigned int flags,
+                                         int max_active,
+                                         ...)
+{
+    static char wq;
+
+    return (struct workqueue_struct *) &wq;
+}
+
+void destroy_workqueue(struct workqueue_struct *wq) {}
+
+static void *work_thread(void *arg)
+{
+    struct work_struct *work = arg;
+
+    work->func(work);
+    return NULL;
+}
+
+/* Without a thread the work runs right away, as flush_work would wait */
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work)
+{
+    work->queued = !pthread_create(&work->thread, NULL, work_thread, work);
+    if (!work->queued)
+        work->func(work);
+    return true;
+}
+
+bool flush_work(struct work_struct *work)
+{
+    if (!work->queued)
+        return false;
+    pthread_join(work->thread, NULL);
+    work->queued = false;
+    return true;
+}
+
+/* A NULL seq_file is stdout */
+int seq_printf(struct seq_file *s, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vfprintf(s ? (FILE *) s : stdout, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+int seq_puts(struct seq_file *s, const char *str)
+{
+    return fputs(str, s ? (FILE *) s : stdout);
+}
+
+int seq_putc(struct seq_file *s, char c)
+{
+    return fputc(c, s ? (FILE *) s : stdout);
+}
+
+/* Only the show functions are called, the debugfs files never opened */
+int single_open(struct file *file,
+                int (*show)(struct seq_file *, void *),
+                void *data)
+{
+    return -ENODEV;
+}
+
+int single_release(struct inode *inode, struct file *file)
+{
+    return 0;
+}
+
+ssize_t seq_read(struct file *file, char *buf, size_t size, loff_t *pos)
+{
+    return -ENODEV;
+}
+
+loff_t seq_lseek(struct file *file, loff_t offset, int whence)
+{
+    return -ENODEV;
+}
+
+int scnprintf(char *buf, size_t size, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return n < (int) size ? n : (int) size - 1;
+}
+
+/* Equal but for a trailing newline on either */
+bool sysfs_streq(const char *a, const char *b)
+{
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    if (*a == *b)
+        return true;
+    return (!*a && *b == '\n' && !b[1]) || (!*b && *a == '\n' && !a[1]);
+}
+
+struct cdev *cdev_alloc(void)
+{
+    return calloc(1, sizeof(struct cdev));
+}
+
+long si_mem_available(void)
+{
+    return sysconf(_SC_AVPHYS_PAGES);
+}
+
+pthread_rwlock_t rcu_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static void rb_replace(struct rb_node *old,
+                       struct rb_node *node,
+                       struct rb_root *root)
+{
+    struct rb_node *parent = old->rb_parent;
+
+    if (!parent)
+        root->rb_node = node;
+    else if (parent->rb_left == old)
+        parent->rb_left = node;
+    else
+        parent->rb_right = node;
+    if (node)
+        node->rb_parent = parent;
+}
+
+void rb_erase(struct rb_node *node, struct rb_root *root)
+{
+    struct rb_node *next = node->rb_right;
+
+    if (!node->rb_left) {
+        rb_replace(node, node->rb_right, root);
+        return;
+    }
+    if (!next) {
+        rb_replace(node, node->rb_left, root);
+        return;
+    }
+    /* the successor takes the place of node */
+    while (next->rb_left)
+        next = next->rb_left;
+    if (next->rb_parent != node) {
+        rb_replace(next, next->rb_right, root);
+        next->rb_right = node->rb_right;
+        next->rb_right->rb_parent = next;
+    }
+    rb_replace(node, next, root);
+    next->rb_left = node->rb_left;
+    next->rb_left->rb_parent = next;
+}
@@ -0,0 +1,465 @@
+#ifndef _USER_KERNEL_H
+#define _USER_KERNEL_H
+/*
+ * Just enough of the kernel API for bn.c, bn_dec.c and fib_engine.c, and
+ * for fibdrv.c with the cache, checkpoints and statistics, to build as a
+ * user-space program. Included ahead of every source by the user target
+ * of the Makefile, which stands empty files in for the <linux/...>
+ * headers those include.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/types.h>
+
+/* bn.c has asm kernels for x86-64, chosen as in the kernel */
+#ifdef __x86_64__
+#define CONFIG_X86_64 1
+#endif
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int64_t s64;
+typedef uint32_t __u32;
+typedef uint64_t __u64;
+typedef unsigned int gfp_t;
+typedef s64 ktime_t;
+typedef unsigned int __poll_t;
+
+#define U64_MAX UINT64_MAX
+#define GFP_KERNEL 0
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define container_of(ptr, type, member) \
+    ((type *) ((char *) (ptr) - offsetof(type, member)))
+#define min(a, b)                    \
+    ({                               \
+        __typeof__(a) _a = (a);      \
+        __typeof__(b) _b = (b);      \
+        _a < _b ? _a : _b;           \
+    })
+#define max(a, b)                    \
+    ({                               \
+        __typeof__(a) _a = (a);      \
+        __typeof__(b) _b = (b);      \
+        _a > _b ? _a : _b;           \
+    })
+#define min_t(type, a, b) min((type) (a), (type) (b))
+#define max_t(type, a, b) max((type) (a), (type) (b))
+#define swap(a, b)                \
+    do {                          \
+        __typeof__(a) _t = (a);   \
+        (a) = (b);                \
+        (b) = _t;                 \
+    } while (0)
+#define READ_ONCE(x) (*(volatile __typeof__(x) *) &(x))
+#define WRITE_ONCE(x, v) (*(volatile __typeof__(x) *) &(x) = (v))
+
+#define ilog2(n) (63 - __builtin_clzll(n))
+#define roundup_pow_of_two(n) \
+    ((n) <= 1 ? 1ULL : 1ULL << (64 - __builtin_clzll((n) - 1)))
+#define div64_u64(a, b) ((u64) (a) / (u64) (b))
+
+/* Memory: everything comes from malloc */
+#define kmalloc(size, gfp) malloc(size)
+#define kvmalloc(size, gfp) malloc(size)
+#define kvmalloc_array(n, size, gfp) calloc(n, size)
+#define kvzalloc(size, gfp) calloc(1, size)
+#define vmalloc(size) malloc(size)
+#define kfree(p) free((void *) (p))
+#define kvfree(p) free((void *) (p))
+#define kzalloc(size, gfp) calloc(1, size)
+#define vfree(p) free((void *) (p))
+
+struct mutex {
+    pthread_mutex_t m;
+};
+#define DEFINE_MUTEX(name) struct mutex name = {PTHREAD_MUTEX_INITIALIZER}
+#define mutex_lock(l) pthread_mutex_lock(&(l)->m)
+#define mutex_unlock(l) pthread_mutex_unlock(&(l)->m)
+#define mutex_init(l) pthread_mutex_init(&(l)->m, NULL)
+#define mutex_trylock(l) (!pthread_mutex_trylock(&(l)->m))
+#define mutex_destroy(l) pthread_mutex_destroy(&(l)->m)
+
+ktime_t ktime_get(void);
+#define ktime_sub(a, b) ((a) - (b))
+#define ktime_to_ns(t) ((s64) (t))
+
+void get_random_bytes(void *buf, size_t len);
+#define cond_resched() ((void) 0)
+unsigned int num_online_cpus(void);
+
+/* Static keys are plain flags */
+struct static_key_false {
+    bool enabled;
+};
+#define DEFINE_STATIC_KEY_FALSE(name) struct static_key_false name
+#define static_branch_likely(key) ((key)->enabled)
+#define static_branch_enable(key) ((key)->enabled = true)
+
+#define X86_FEATURE_ADX "adx"
+#define X86_FEATURE_BMI2 "bmi2"
+#define boot_cpu_has(feature) __builtin_cpu_supports(feature)
+
+/* A workqueue runs every work item on a thread of its own */
+struct workqueue_struct;
+struct work_struct {
+    void (*func)(struct work_struct *work);
+    pthread_t thread;
+    bool queued; /* thread is still to be joined */
+};
+#define WQ_UNBOUND 0
+#define WQ_SYSFS 0
+struct workqueue_struct *alloc_workqueue(const char *fmt,
+                                         unsigned int flags,
+                                         int max_active,
+                                         ...);
+void destroy_workqueue(struct workqueue_struct *wq);
+#define INIT_WORK(w, f) ((w)->func = (f), (w)->queued = false)
+#define INIT_WORK_ONSTACK(w, f) INIT_WORK(w, f)
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work);
+bool flush_work(struct work_struct *work);
+/* A queued item has its thread already, so it is waited for instead */
+#define cancel_work_sync(w) (flush_work(w), false)
+#define destroy_work_on_stack(w) ((void) (w))
+
+/*
+ * The character device: a file is a struct file the caller opens through
+ * the file_operations, registering it does nothing
+ */
+struct module;
+struct class;
+struct device;
+struct inode {
+    dev_t i_rdev;
+};
+struct file {
+    void *private_data;
+    loff_t f_pos;
+};
+struct poll_table_struct;
+typedef struct poll_table_struct poll_table;
+struct seq_file;
+struct file_operations {
+    struct module *owner;
+    ssize_t (*read)(struct file *, char *, size_t, loff_t *);
+    ssize_t (*write)(struct file *, const char *, size_t, loff_t *);
+    int (*open)(struct inode *, struct file *);
+    int (*release)(struct inode *, struct file *);
+    loff_t (*llseek)(struct file *, loff_t, int);
+    long (*unlocked_ioctl)(struct file *, unsigned int, unsigned long);
+    long (*compat_ioctl)(struct file *, unsigned int, unsigned long);
+    __poll_t (*poll)(struct file *, poll_table *);
+    int (*show)(struct seq_file *s, void *unused);
+};
+struct cdev {
+    const struct file_operations *ops;
+};
+#define THIS_MODULE ((struct module *) NULL)
+#define compat_ptr_ioctl NULL
+struct cdev *cdev_alloc(void);
+#define cdev_add(cdev, dev, count) 0
+#define cdev_del(cdev) free(cdev)
+#define alloc_chrdev_region(dev, first, count, name) (*(dev) = 0)
+#define unregister_chrdev_region(dev, count) ((void) (dev))
+#define class_create(owner, name) ((struct class *) (name))
+#define class_destroy(cls) ((void) (cls))
+#define device_create(cls, parent, dev, data, name) ((struct device *) (name))
+#define device_destroy(cls, dev) ((void) (dev))
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1UL << PAGE_SHIFT)
+long si_mem_available(void);
+
+/* User pointers are plain pointers */
+#define __user
+#define access_ok(addr, size) true
+#define copy_to_user(to, from, n) (memcpy(to, from, n), 0UL)
+#define copy_from_user(to, from, n) (memcpy(to, from, n), 0UL)
+#define get_user(x, ptr) ((x) = *(ptr), 0)
+#define put_user(x, ptr) (*(ptr) = (x), 0)
+#define u64_to_user_ptr(x) ((void *) (uintptr_t) (x))
+
+/* Module boilerplate; parameters are the variables themselves */
+#define __init
+#define __exit
+#define MODULE_LICENSE(s)
+#define MODULE_AUTHOR(s)
+#define MODULE_DESCRIPTION(s)
+#define MODULE_VERSION(s)
+#define MODULE_PARM_DESC(name, desc)
+#define module_param(name, type, perm)
+#define module_param_named(name, var, type, perm)
+struct kernel_param;
+struct kernel_param_ops {
+    int (*set)(const char *val, const struct kernel_param *kp);
+    int (*get)(char *buf, const struct kernel_param *kp);
+};
+#define module_param_cb(name, ops, arg, perm)                             \
+    static const struct kernel_param_ops *const __param_##name            \
+        __attribute__((unused)) = (ops)
+#define module_init(fn)
+#define module_exit(fn)
+#define KERN_ALERT ""
+#define printk(...) fprintf(stderr, __VA_ARGS__)
+int scnprintf(char *buf, size_t size, const char *fmt, ...);
+bool sysfs_streq(const char *a, const char *b);
+#define ERESTARTSYS 512
+
+/* debugfs files are not created, their show functions can be called */
+struct dentry;
+#define DEFINE_SHOW_ATTRIBUTE(name) \
+    static const struct file_operations name##_fops = {.show = name##_show}
+#define debugfs_create_dir(name, parent) ((struct dentry *) NULL)
+#define debugfs_create_file(name, mode, dir, data, fops) ((void) (fops))
+#define debugfs_remove_recursive(dentry) ((void) (dentry))
+int seq_printf(struct seq_file *s, const char *fmt, ...);
+int seq_puts(struct seq_file *s, const char *str);
+int seq_putc(struct seq_file *s, char c);
+int single_open(struct file *file,
+                int (*show)(struct seq_file *, void *),
+                void *data);
+int single_release(struct inode *inode, struct file *file);
+ssize_t seq_read(struct file *file, char *buf, size_t size, loff_t *pos);
+loff_t seq_lseek(struct file *file, loff_t offset, int whence);
+
+/* Tracepoints compile to nothing */
+#define TP_PROTO(...) __VA_ARGS__
+#define TP_ARGS(...) __VA_ARGS__
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print) \
+    static inline void trace_##name(proto) {}
+#define TRACE_DEFINE_ENUM(a)
+
+/* Atomics and reference counts on the GCC builtins */
+typedef struct {
+    long long counter;
+} atomic64_t;
+#define ATOMIC64_INIT(i) {(i)}
+#define atomic64_read(v) __atomic_load_n(&(v)->counter, __ATOMIC_SEQ_CST)
+#define atomic64_add_return(i, v) \
+    __atomic_add_fetch(&(v)->counter, i, __ATOMIC_SEQ_CST)
+#define atomic64_sub(i, v) \
+    ((void) __atomic_sub_fetch(&(v)->counter, i, __ATOMIC_SEQ_CST))
+
+struct kref {
+    int refcount;
+};
+static inline void kref_init(struct kref *kref)
+{
+    kref->refcount = 1;
+}
+static inline void kref_get(struct kref *kref)
+{
+    __atomic_add_fetch(&kref->refcount, 1, __ATOMIC_SEQ_CST);
+}
+static inline bool kref_get_unless_zero(struct kref *kref)
+{
+    int n = __atomic_load_n(&kref->refcount, __ATOMIC_SEQ_CST);
+
+    while (n && !__atomic_compare_exchange_n(&kref->refcount, &n, n + 1,
+                                             false, __ATOMIC_SEQ_CST,
+                                             __ATOMIC_SEQ_CST))
+        ;
+    return n;
+}
+static inline int kref_put(struct kref *kref, void (*release)(struct kref *))
+{
+    if (__atomic_sub_fetch(&kref->refcount, 1, __ATOMIC_SEQ_CST))
+        return 0;
+    release(kref);
+    return 1;
+}
+
+/* Per-CPU data has a single CPU, updated atomically */
+#define __percpu
+#define DEFINE_PER_CPU(type, name) type name
+#define per_cpu(var, cpu) (var)
+#define alloc_percpu(type) ((type *) calloc(1, sizeof(type)))
+#define free_percpu(p) free(p)
+#define per_cpu_ptr(p, cpu) (p)
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < 1; (cpu)++)
+#define this_cpu_add(pcp, v) \
+    ((void) __atomic_add_fetch(&(pcp), v, __ATOMIC_RELAXED))
+#define this_cpu_inc(pcp) this_cpu_add(pcp, 1)
+
+/*
+ * RCU readers hold a shared lock that a grace period takes exclusively,
+ * so kvfree_rcu frees only after the lookups under way are done
+ */
+extern pthread_rwlock_t rcu_lock;
+#define rcu_read_lock() pthread_rwlock_rdlock(&rcu_lock)
+#define rcu_read_unlock() pthread_rwlock_unlock(&rcu_lock)
+#define synchronize_rcu()                   \
+    do {                                    \
+        pthread_rwlock_wrlock(&rcu_lock);   \
+        pthread_rwlock_unlock(&rcu_lock);   \
+    } while (0)
+#define kvfree_rcu(p, field) \
+    do {                     \
+        synchronize_rcu();   \
+        kvfree(p);           \
+    } while (0)
+struct rcu_head {
+    void *next;
+};
+
+/* Wait queues are one condition variable each */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} wait_queue_head_t;
+#define DECLARE_WAIT_QUEUE_HEAD(name)                   \
+    wait_queue_head_t name = {PTHREAD_MUTEX_INITIALIZER, \
+                              PTHREAD_COND_INITIALIZER}
+#define init_waitqueue_head(wq)                 \
+    do {                                        \
+        pthread_mutex_init(&(wq)->lock, NULL);  \
+        pthread_cond_init(&(wq)->cond, NULL);   \
+    } while (0)
+#define wake_up_interruptible_all(wq)          \
+    do {                                       \
+        pthread_mutex_lock(&(wq)->lock);       \
+        pthread_cond_broadcast(&(wq)->cond);   \
+        pthread_mutex_unlock(&(wq)->lock);     \
+    } while (0)
+#define wake_up_interruptible(wq) wake_up_interruptible_all(wq)
+#define wait_event_interruptible(wq, condition)               \
+    ({                                                        \
+        pthread_mutex_lock(&(wq).lock);                       \
+        while (!(condition))                                  \
+            pthread_cond_wait(&(wq).cond, &(wq).lock);        \
+        pthread_mutex_unlock(&(wq).lock);                     \
+        0;                                                    \
+    })
+#define poll_wait(file, wq, p) ((void) (wq))
+
+/* Lists and the hash table, as in <linux/list.h> */
+struct list_head {
+    struct list_head *next, *prev;
+};
+#define LIST_HEAD(name) struct list_head name = {&(name), &(name)}
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+    list->next = list->prev = list;
+}
+static inline void __list_add(struct list_head *entry,
+                              struct list_head *prev,
+                              struct list_head *next)
+{
+    next->prev = entry;
+    entry->next = next;
+    entry->prev = prev;
+    prev->next = entry;
+}
+static inline void list_add(struct list_head *entry, struct list_head *head)
+{
+    __list_add(entry, head, head->next);
+}
+static inline void list_add_tail(struct list_head *entry,
+                                 struct list_head *head)
+{
+    __list_add(entry, head->prev, head);
+}
+static inline void list_del(struct list_head *entry)
+{
+    entry->next->prev = entry->prev;
+    entry->prev->next = entry->next;
+}
+static inline void list_move(struct list_head *entry, struct list_head *head)
+{
+    list_del(entry);
+    list_add(entry, head);
+}
+static inline void list_move_tail(struct list_head *entry,
+                                  struct list_head *head)
+{
+    list_del(entry);
+    list_add_tail(entry, head);
+}
+static inline bool list_empty(const struct list_head *head)
+{
+    return head->next == head;
+}
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+#define list_first_entry_or_null(head, type, member) \
+    (list_empty(head) ? NULL : list_entry((head)->next, type, member))
+#define list_last_entry(head, type, member) \
+    list_entry((head)->prev, type, member)
+#define list_for_each_entry_safe(pos, n, head, member)                     \
+    for (pos = list_entry((head)->next, __typeof__(*pos), member),         \
+        n = list_entry(pos->member.next, __typeof__(*pos), member);        \
+         &pos->member != (head);                                           \
+         pos = n, n = list_entry(n->member.next, __typeof__(*n), member))
+
+struct hlist_node {
+    struct hlist_node *next, **pprev;
+};
+struct hlist_head {
+    struct hlist_node *first;
+};
+#define DEFINE_HASHTABLE(name, bits) struct hlist_head name[1 << (bits)]
+#define hash_head(table, key) \
+    (&(table)[(unsigned long long) (key) % ARRAY_SIZE(table)])
+/* published with a release store, as rcu_assign_pointer does */
+static inline void hlist_add_head_rcu(struct hlist_node *n,
+                                      struct hlist_head *h)
+{
+    n->next = h->first;
+    n->pprev = &h->first;
+    if (h->first)
+        h->first->pprev = &n->next;
+    __atomic_store_n(&h->first, n, __ATOMIC_RELEASE);
+}
+static inline void hlist_del_rcu(struct hlist_node *n)
+{
+    if (n->next)
+        n->next->pprev = n->pprev;
+    __atomic_store_n(n->pprev, n->next, __ATOMIC_RELEASE);
+}
+#define hash_add_rcu(table, node, key) \
+    hlist_add_head_rcu(node, hash_head(table, key))
+#define hash_del_rcu(node) hlist_del_rcu(node)
+#define hlist_entry_safe(ptr, type, member)                   \
+    ({                                                        \
+        struct hlist_node *_p = (ptr);                        \
+        _p ? container_of(_p, type, member) : NULL;           \
+    })
+#define hash_for_each_possible_rcu(table, obj, member, key)                 \
+    for (obj = hlist_entry_safe(                                            \
+             __atomic_load_n(&hash_head(table, key)->first,                 \
+                             __ATOMIC_ACQUIRE),                             \
+             __typeof__(*obj), member);                                     \
+         obj; obj = hlist_entry_safe(                                       \
+                  __atomic_load_n(&obj->member.next, __ATOMIC_ACQUIRE),     \
+                  __typeof__(*obj), member))
+#define hash_for_each_possible hash_for_each_possible_rcu
+
+/* An unbalanced tree, which is all a test needs of the rbtree */
+struct rb_node {
+    struct rb_node *rb_parent, *rb_left, *rb_right;
+};
+struct rb_root {
+    struct rb_node *rb_node;
+};
+#define RB_ROOT ((struct rb_root){NULL})
+#define rb_entry(ptr, type, member) container_of(ptr, type, member)
+static inline void rb_link_node(struct rb_node *node,
+                                struct rb_node *parent,
+                                struct rb_node **link)
+{
+    node->rb_parent = parent;
+    node->rb_left = node->rb_right = NULL;
+    *link = node;
+}
+#define rb_insert_color(node, root) ((void) (root))
+void rb_erase(struct rb_node *node, struct rb_root *root);
+
+#endif /* _USER_KERNEL_H */